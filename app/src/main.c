@@ -3,8 +3,11 @@
 
 #include <pthread.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <zz_event.h>
+#include <zz_event_capture.h>
+#include <zz_event_trace.h>
 #include <gui.h>
 #include <mainapp.h>
 #include <utils.h>
@@ -25,6 +28,20 @@ int main(int argc, char **argv)
     // Initializes the event module from the main thread
     zz_event_init();
 
+    // Record the traffic to be replayed later with zzevent_replay
+    const char *capture_path = getenv("ZZ_EVENT_CAPTURE");
+    if (capture_path)
+    {
+        zz_event_capture_start(capture_path);
+    }
+
+    // Time every event, to be opened with chrome://tracing or Perfetto
+    const char *trace_path = getenv("ZZ_EVENT_TRACE");
+    if (trace_path)
+    {
+        zz_event_trace_start(0);
+    }
+
     // mainapp and gui init initializes their event queues and handlers
     mainapp_init();
     gui_init();
@@ -47,6 +64,16 @@ int main(int argc, char **argv)
     // Cleanup the mainapp and gui modules
     mainapp_deinit();
     gui_deinit();
+
+    if (zz_event_capture_is_active())
+    {
+        zz_event_capture_stop();
+    }
+    if (zz_event_trace_is_active())
+    {
+        zz_event_trace_stop();
+        zz_event_trace_dump(trace_path);
+    }
     zz_event_deinit();
 
     return EXIT_SUCCESS;
@@ -54,17 +81,21 @@ int main(int argc, char **argv)
 
 void signal_handler(int sig)
 {
+    // Only async-signal-safe calls here: write instead of printf and the
+    // preallocated urgent lane instead of the regular event allocation
     if (sig == SIGINT)
     {
-        printf("\nSIGINT caught. Requesting to quit.\n");
+        static const char quit_msg[] = "\nSIGINT caught. Requesting to quit.\n";
+        write(STDOUT_FILENO, quit_msg, sizeof(quit_msg) - 1);
         signal(sig, SIG_IGN);
-        int err = zz_event_create_event_in_queue(
+        int err = zz_event_post_urgent_event(
             MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_QUIT_APP,
-            ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0, NULL);
+            ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0);
 
         if (err)
         {
-            fprintf(stderr, "GUI fail!");
+            static const char err_msg[] = "Unable to request to quit.\n";
+            write(STDERR_FILENO, err_msg, sizeof(err_msg) - 1);
             signal(sig, signal_handler);
         }
     }
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include <zz_event_channel.h>
+
 /// Event queue processed by the mainapp
 #define MAINAPP_EVENT_QUEUE 1
 /// Event queue processed by the GUI
@@ -13,6 +15,7 @@ typedef enum
 {
     /// Event for printing a text in the stdout
     EVENT_GUI_PRINT_TEXT = 1,
+    /// Event carrying the square computed by the mainapp (gui_get_square_ready)
     EVENT_GUI_GET_SQUARE_READY = 2,
 } gui_events_t;
 
@@ -21,7 +24,14 @@ typedef enum
 {
     /// Event to finalize the mainapp
     EVENT_MAINAPP_QUIT_APP = 1,
+    /// Event requesting the square of a number (mainapp_get_square)
     EVENT_MAINAPP_GET_SQUARE = 2,
 } mainapp_events_t;
 
+/// Requests the mainapp to compute the square of a number
+ZZ_EVENT_CHANNEL(mainapp_get_square, MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_GET_SQUARE, int32_t);
+
+/// Delivers the square computed by the mainapp to the GUI
+ZZ_EVENT_CHANNEL(gui_get_square_ready, GUI_EVENT_QUEUE, EVENT_GUI_GET_SQUARE_READY, int32_t);
+
 #endif // __DEFINITIONS_H__
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+
+#include <zz_event.hpp>
+#include <zz_event_coro.hpp>
+
+/**
+ * @brief Builds and runs the C++ layers over the zz_event C API
+ *
+ * Instantiates the templates of zz_event.hpp and zz_event_coro.hpp, so a
+ * change in the C API that breaks them fails the build, and checks a round
+ * trip through both. An event of the request type posted through the C API
+ * with another payload must not reach the typed handler.
+ */
+
+/// Queue of the requests
+#define CXXCHECK_REQUEST_QUEUE 1
+/// Queue of the replies
+#define CXXCHECK_REPLY_QUEUE 2
+/// Event type of the requests
+#define CXXCHECK_EVENT_REQUEST 1
+/// Event type of the replies
+#define CXXCHECK_EVENT_REPLY 2
+/// Event type awaited by next_event
+#define CXXCHECK_EVENT_NOTIFY 3
+
+namespace
+{
+
+zz::Task request_flow(std::string name, std::optional<std::string> *reply)
+{
+    *reply = co_await zz::request<std::string>(
+        CXXCHECK_REQUEST_QUEUE, CXXCHECK_EVENT_REQUEST, std::move(name),
+        CXXCHECK_REPLY_QUEUE, CXXCHECK_EVENT_REPLY);
+}
+
+zz::Task notify_flow(uint32_t *event_type)
+{
+    zz_event_list_t *event = co_await zz::next_event(CXXCHECK_REPLY_QUEUE, CXXCHECK_EVENT_NOTIFY);
+    *event_type = event ? event->event_type : 0;
+}
+
+} // namespace
+
+int main()
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+
+    std::optional<std::string> reply;
+    uint32_t notified = 0;
+    uint32_t n_requests = 0;
+    {
+        zz::Queue<std::string> requests(CXXCHECK_REQUEST_QUEUE);
+        zz::Queue<std::string> replies(CXXCHECK_REPLY_QUEUE);
+        auto registration = requests.on(CXXCHECK_EVENT_REQUEST, [&n_requests](std::string &name) {
+            n_requests++;
+            zz::post(CXXCHECK_REPLY_QUEUE, CXXCHECK_EVENT_REPLY, "Hello " + name);
+        });
+
+        int32_t not_a_string = 1;
+        zz_event_create_event_in_queue(CXXCHECK_REQUEST_QUEUE, CXXCHECK_EVENT_REQUEST, ZZ_EVENT_DATA_TYPE_SIGNED_INT,
+                                       &not_a_string, sizeof(not_a_string), nullptr);
+        request_flow("world", &reply);
+        notify_flow(&notified);
+        requests.process();
+        replies.emplace(CXXCHECK_EVENT_NOTIFY, "notify");
+        replies.process();
+    }
+
+    zz_event_deinit();
+
+    if (reply != "Hello world" || notified != CXXCHECK_EVENT_NOTIFY || n_requests != 1)
+    {
+        fprintf(stderr, "Unexpected reply <%s>, notification <%u> or %u requests handled.\n",
+                reply ? reply->c_str() : "none", notified, n_requests);
+        return EXIT_FAILURE;
+    }
+    printf("C++ layers OK.\n");
+
+    return EXIT_SUCCESS;
+}
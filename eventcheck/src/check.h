@@ -0,0 +1,49 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * Minimal expectations for the behaviour checks of the event module.
+ *
+ * A failed CHECK is reported with its location and the check goes on, so a
+ * run lists all the failures. CHECK_RESULT ends main with the exit status
+ * expected by ctest.
+ */
+
+/// Checks a condition, reporting it if false
+#define CHECK(condition) check_condition((condition), #condition, __FILE__, __LINE__)
+
+/// Exit status of the check, EXIT_FAILURE if any CHECK failed
+#define CHECK_RESULT() (check_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+/// Number of failed checks
+static int check_failures = 0;
+
+/**
+ * @brief Reports a failed condition
+ *
+ * @param ok [in] The result of the condition
+ * @param condition [in] The condition as written in the check
+ * @param file [in] The source file of the check
+ * @param line [in] The line of the check
+ * @return true if the condition holds
+ */
+static inline bool check_condition(
+    bool ok,
+    const char *condition,
+    const char *file,
+    int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        check_failures++;
+    }
+
+    return ok;
+}
+
+#endif // __CHECK_H__
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zz_event.h>
+
+#include "check.h"
+
+/**
+ * Checks how the events of a type with a batch callback are grouped: the
+ * consecutive ones go in batches of up to ZZ_EVENT_BATCH_MAX_EVENTS, and an
+ * event of another type, data type or payload size starts a new batch.
+ */
+
+/// Queue of the batches
+#define CHECK_QUEUE 1
+/// Event type with a batch callback
+#define CHECK_EVENT_BATCH 1
+/// Event type with a callback for single events
+#define CHECK_EVENT_SINGLE 2
+/// Events posted at once, more than two full batches
+#define CHECK_EVENTS (2 * ZZ_EVENT_BATCH_MAX_EVENTS + 22)
+/// Maximum dispatches logged
+#define CHECK_LOG_SIZE 16
+
+/**
+ * @brief A batch, or a single event, given to the callbacks
+ */
+typedef struct dispatch_t
+{
+    uint32_t event_type;
+    zz_event_data_type_t data_type;
+    uint32_t data_size;
+    /// 0 for a single event
+    uint32_t n_events;
+    /// Payload of the first event
+    uint64_t first;
+    /// The payloads of the batch follow the first one, increasing by one
+    bool consecutive;
+} dispatch_t;
+
+static dispatch_t dispatch_log[CHECK_LOG_SIZE];
+
+static uint32_t n_logged = 0;
+
+/// Events seen by the wildcard callback, called for every event
+static uint32_t n_wildcard_events = 0;
+
+void log_batch(
+    const zz_event_batch_t *batch,
+    void *ctx);
+
+void log_single(
+    zz_event_list_t *event);
+
+void count_wildcard(
+    zz_event_list_t *event,
+    void *ctx);
+
+uint64_t payload_value(
+    const void *data,
+    uint32_t data_size,
+    uint32_t index);
+
+void post_values(
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    uint32_t data_size,
+    uint32_t first,
+    uint32_t n_events);
+
+void process_queue(void);
+
+bool is_logged(
+    uint32_t index,
+    uint32_t event_type,
+    uint32_t data_size,
+    uint32_t n_events,
+    uint64_t first);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE);
+    zz_event_register_event_batch_callback(CHECK_QUEUE, CHECK_EVENT_BATCH, &log_batch, NULL);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_SINGLE, &log_single);
+    zz_event_register_event_range_callback(CHECK_QUEUE, CHECK_EVENT_BATCH, CHECK_EVENT_SINGLE, &count_wildcard, NULL);
+
+    // Full batches, then the rest
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint32_t), 0, CHECK_EVENTS);
+    process_queue();
+    CHECK(n_logged == 3);
+    CHECK(is_logged(0, CHECK_EVENT_BATCH, sizeof(uint32_t), ZZ_EVENT_BATCH_MAX_EVENTS, 0));
+    CHECK(is_logged(1, CHECK_EVENT_BATCH, sizeof(uint32_t), ZZ_EVENT_BATCH_MAX_EVENTS, ZZ_EVENT_BATCH_MAX_EVENTS));
+    CHECK(is_logged(2, CHECK_EVENT_BATCH, sizeof(uint32_t), CHECK_EVENTS - 2 * ZZ_EVENT_BATCH_MAX_EVENTS,
+                    2 * ZZ_EVENT_BATCH_MAX_EVENTS));
+    CHECK(n_wildcard_events == CHECK_EVENTS);
+
+    // An event of another type ends the batch
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint32_t), 0, 3);
+    post_values(CHECK_EVENT_SINGLE, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint32_t), 3, 1);
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint32_t), 4, 2);
+    process_queue();
+    CHECK(n_logged == 3);
+    CHECK(is_logged(0, CHECK_EVENT_BATCH, sizeof(uint32_t), 3, 0));
+    CHECK(is_logged(1, CHECK_EVENT_SINGLE, sizeof(uint32_t), 0, 3));
+    CHECK(is_logged(2, CHECK_EVENT_BATCH, sizeof(uint32_t), 2, 4));
+    CHECK(n_wildcard_events == 6);
+
+    // So does a payload of another size or data type
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint32_t), 0, 2);
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(uint64_t), 2, 2);
+    post_values(CHECK_EVENT_BATCH, ZZ_EVENT_DATA_TYPE_SIGNED_INT, sizeof(uint64_t), 4, 2);
+    process_queue();
+    CHECK(n_logged == 3);
+    CHECK(is_logged(0, CHECK_EVENT_BATCH, sizeof(uint32_t), 2, 0));
+    CHECK(is_logged(1, CHECK_EVENT_BATCH, sizeof(uint64_t), 2, 2));
+    CHECK(is_logged(2, CHECK_EVENT_BATCH, sizeof(uint64_t), 2, 4));
+    CHECK(dispatch_log[1].data_type == ZZ_EVENT_DATA_TYPE_UNSIGNED_INT);
+    CHECK(dispatch_log[2].data_type == ZZ_EVENT_DATA_TYPE_SIGNED_INT);
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void log_batch(const zz_event_batch_t *batch, void *ctx)
+{
+    (void)ctx;
+    if (n_logged < CHECK_LOG_SIZE)
+    {
+        dispatch_t *dispatch = &dispatch_log[n_logged];
+        dispatch->event_type = batch->event_type;
+        dispatch->data_type = batch->data_type;
+        dispatch->data_size = batch->data_size;
+        dispatch->n_events = batch->n_events;
+        dispatch->first = payload_value(batch->data, batch->data_size, 0);
+        dispatch->consecutive = true;
+        for (uint32_t i = 1; i < batch->n_events; i++)
+        {
+            dispatch->consecutive &= payload_value(batch->data, batch->data_size, i) == dispatch->first + i;
+        }
+    }
+    n_logged++;
+}
+
+void log_single(zz_event_list_t *event)
+{
+    if (n_logged < CHECK_LOG_SIZE)
+    {
+        dispatch_t *dispatch = &dispatch_log[n_logged];
+        dispatch->event_type = event->event_type;
+        dispatch->data_type = event->data_type;
+        dispatch->data_size = event->data_size;
+        dispatch->n_events = 0;
+        dispatch->first = payload_value(zz_event_data(event), event->data_size, 0);
+        dispatch->consecutive = true;
+    }
+    n_logged++;
+}
+
+void count_wildcard(zz_event_list_t *event, void *ctx)
+{
+    (void)event;
+    (void)ctx;
+    n_wildcard_events++;
+}
+
+uint64_t payload_value(const void *data, uint32_t data_size, uint32_t index)
+{
+    if (data_size == sizeof(uint64_t))
+    {
+        return ((const uint64_t *)data)[index];
+    }
+
+    return ((const uint32_t *)data)[index];
+}
+
+void post_values(uint32_t event_type, zz_event_data_type_t data_type, uint32_t data_size, uint32_t first,
+                 uint32_t n_events)
+{
+    uint32_t values_32[CHECK_EVENTS];
+    uint64_t values_64[CHECK_EVENTS];
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        values_32[i] = first + i;
+        values_64[i] = first + i;
+    }
+    const void *values = data_size == sizeof(uint64_t) ? (const void *)values_64 : (const void *)values_32;
+    CHECK(zz_event_create_events_in_queue(CHECK_QUEUE, event_type, data_type, values, data_size, n_events) == 0);
+}
+
+void process_queue(void)
+{
+    memset(dispatch_log, 0, sizeof(dispatch_log));
+    n_logged = 0;
+    n_wildcard_events = 0;
+
+    int32_t n_events = 0;
+    CHECK(zz_event_process_events(CHECK_QUEUE, &n_events) == 0);
+}
+
+bool is_logged(uint32_t index, uint32_t event_type, uint32_t data_size, uint32_t n_events, uint64_t first)
+{
+    const dispatch_t *dispatch = &dispatch_log[index];
+
+    return dispatch->event_type == event_type && dispatch->data_size == data_size &&
+           dispatch->n_events == n_events && dispatch->first == first && dispatch->consecutive;
+}
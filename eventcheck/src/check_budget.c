@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <zz_event.h>
+
+#include "check.h"
+
+/**
+ * Checks that processing stops at the event and time budgets, and that
+ * zz_event_process_queues takes turns between the queues.
+ */
+
+/// Queues processed together
+#define CHECK_QUEUE_A 1
+#define CHECK_QUEUE_B 2
+/// Event type of the fast events
+#define CHECK_EVENT_FAST 1
+/// Event type of the events taking CHECK_SLOW_EVENT_US to process
+#define CHECK_EVENT_SLOW 2
+/// Processing time of a slow event
+#define CHECK_SLOW_EVENT_US 1000
+/// Events posted to every queue
+#define CHECK_EVENTS_PER_QUEUE 20
+/// Events of a queue per pass of zz_event_process_queues
+#define CHECK_EVENTS_PER_PASS 5
+
+/// The queues of the events in the order they were dispatched
+static int32_t dispatch_order[2 * CHECK_EVENTS_PER_QUEUE];
+
+static uint32_t n_dispatched = 0;
+
+void record_event(
+    zz_event_list_t *event,
+    void *ctx);
+
+void slow_event(
+    zz_event_list_t *event);
+
+void post_events(
+    int32_t queue_id,
+    uint32_t event_type,
+    uint32_t n_events);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE_A);
+    zz_event_create_queue(CHECK_QUEUE_B);
+    static int32_t queue_ids[2] = {CHECK_QUEUE_A, CHECK_QUEUE_B};
+    zz_event_register_event_type_ctx_callback(CHECK_QUEUE_A, CHECK_EVENT_FAST, &record_event, &queue_ids[0]);
+    zz_event_register_event_type_ctx_callback(CHECK_QUEUE_B, CHECK_EVENT_FAST, &record_event, &queue_ids[1]);
+    zz_event_register_event_type_callback(CHECK_QUEUE_A, CHECK_EVENT_SLOW, &slow_event);
+
+    // Event budget of a single queue
+    post_events(CHECK_QUEUE_A, CHECK_EVENT_FAST, CHECK_EVENTS_PER_QUEUE);
+    int32_t n_events = 0;
+    uint32_t n_remaining = 0;
+    CHECK(zz_event_process_events_budget(CHECK_QUEUE_A, CHECK_EVENTS_PER_PASS, 0, &n_events, &n_remaining) == 0);
+    CHECK(n_events == CHECK_EVENTS_PER_PASS);
+    CHECK(n_remaining == CHECK_EVENTS_PER_QUEUE - CHECK_EVENTS_PER_PASS);
+    CHECK(zz_event_process_events_budget(CHECK_QUEUE_A, 0, 0, &n_events, &n_remaining) == 0);
+    CHECK(n_events == CHECK_EVENTS_PER_QUEUE - CHECK_EVENTS_PER_PASS);
+    CHECK(n_remaining == 0);
+
+    // Round robin between the queues, CHECK_EVENTS_PER_PASS events each
+    n_dispatched = 0;
+    post_events(CHECK_QUEUE_A, CHECK_EVENT_FAST, CHECK_EVENTS_PER_QUEUE);
+    post_events(CHECK_QUEUE_B, CHECK_EVENT_FAST, CHECK_EVENTS_PER_QUEUE);
+    CHECK(zz_event_process_queues(queue_ids, 2, CHECK_EVENTS_PER_PASS, 0, &n_events, &n_remaining) == 0);
+    CHECK(n_events == 2 * CHECK_EVENTS_PER_QUEUE);
+    CHECK(n_remaining == 0);
+    CHECK(n_dispatched == 2 * CHECK_EVENTS_PER_QUEUE);
+    for (uint32_t i = 0; i < n_dispatched; i++)
+    {
+        int32_t expected = queue_ids[(i / CHECK_EVENTS_PER_PASS) % 2];
+        if (!CHECK(dispatch_order[i] == expected))
+        {
+            fprintf(stderr, "Event %u dispatched from queue <%d>.\n", i, dispatch_order[i]);
+            break;
+        }
+    }
+
+    // Time budget, checked after every event
+    post_events(CHECK_QUEUE_A, CHECK_EVENT_SLOW, CHECK_EVENTS_PER_QUEUE);
+    CHECK(zz_event_process_events_budget(CHECK_QUEUE_A, 0, 5 * CHECK_SLOW_EVENT_US, &n_events, &n_remaining) == 0);
+    CHECK(n_events >= 1 && n_events <= 5);
+    CHECK(n_remaining == CHECK_EVENTS_PER_QUEUE - (uint32_t)n_events);
+    CHECK(zz_event_process_queues(queue_ids, 2, 0, 5 * CHECK_SLOW_EVENT_US, &n_events, &n_remaining) == 0);
+    CHECK(n_events >= 1 && n_events <= 5);
+    CHECK(n_remaining > 0);
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void record_event(zz_event_list_t *event, void *ctx)
+{
+    (void)event;
+    if (n_dispatched < 2 * CHECK_EVENTS_PER_QUEUE)
+    {
+        dispatch_order[n_dispatched] = *(const int32_t *)ctx;
+    }
+    n_dispatched++;
+}
+
+void slow_event(zz_event_list_t *event)
+{
+    (void)event;
+    struct timespec delay = {0, CHECK_SLOW_EVENT_US * 1000};
+    nanosleep(&delay, NULL);
+}
+
+void post_events(int32_t queue_id, uint32_t event_type, uint32_t n_events)
+{
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        CHECK(zz_event_create_event_in_queue(queue_id, event_type, ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0, NULL) == 0);
+    }
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <zz_event.h>
+#include <zz_event_buffer.h>
+
+#include "check.h"
+
+/**
+ * Checks that the buffers go back to the pool when they are released,
+ * dispatched or cancelled, and come out of it for the next allocation of
+ * the same capacity, and that a callback taking a buffer with
+ * zz_event_buffer_take keeps it out of the pool.
+ */
+
+/// Queue of the buffer events
+#define CHECK_QUEUE 1
+/// Queue the taken buffers are forwarded to
+#define CHECK_QUEUE_FORWARD 2
+/// Event type of the buffers left to the event module
+#define CHECK_EVENT_BUFFER 1
+/// Event type of the buffers taken by the callback
+#define CHECK_EVENT_TAKE 2
+/// Size of the buffers, a capacity of 2^ZZ_EVENT_BUFFER_MIN_SHIFT
+#define CHECK_BUFFER_SIZE 50000
+/// Byte written in the buffers
+#define CHECK_BUFFER_FILL 0x5A
+
+/// Buffer seen by the last callback
+static zz_event_buffer_t *dispatched_buffer = NULL;
+
+/// Buffer taken by the last callback of CHECK_EVENT_TAKE
+static zz_event_buffer_t *taken_buffer = NULL;
+
+void on_buffer(
+    zz_event_list_t *event);
+
+void on_take(
+    zz_event_list_t *event);
+
+zz_event_buffer_t *alloc_filled(
+    uint64_t size);
+
+bool is_filled(
+    const zz_event_buffer_t *buffer);
+
+void process_queue(
+    int32_t queue_id);
+
+void check_pool_reuse(void);
+
+void check_pool_depth(void);
+
+void check_event_release(void);
+
+void check_buffer_take(void);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE);
+    zz_event_create_queue(CHECK_QUEUE_FORWARD);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_BUFFER, &on_buffer);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_TAKE, &on_take);
+    zz_event_register_event_type_callback(CHECK_QUEUE_FORWARD, CHECK_EVENT_BUFFER, &on_buffer);
+
+    zz_event_buffer_pool_trim();
+    check_pool_reuse();
+    check_pool_depth();
+    check_event_release();
+    check_buffer_take();
+    zz_event_buffer_pool_trim();
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void on_buffer(zz_event_list_t *event)
+{
+    dispatched_buffer = zz_event_buffer_from_event(event);
+    CHECK(dispatched_buffer != NULL && is_filled(dispatched_buffer));
+}
+
+void on_take(zz_event_list_t *event)
+{
+    dispatched_buffer = zz_event_buffer_from_event(event);
+    taken_buffer = zz_event_buffer_take(event);
+    CHECK(taken_buffer != NULL && taken_buffer == dispatched_buffer);
+    CHECK(zz_event_buffer_from_event(event) == NULL);
+    CHECK(zz_event_buffer_take(event) == NULL);
+}
+
+zz_event_buffer_t *alloc_filled(uint64_t size)
+{
+    zz_event_buffer_t *buffer = NULL;
+    if (!CHECK(zz_event_buffer_alloc(size, 0, &buffer) == 0))
+    {
+        return NULL;
+    }
+    memset(buffer->data, CHECK_BUFFER_FILL, buffer->size);
+
+    return buffer;
+}
+
+bool is_filled(const zz_event_buffer_t *buffer)
+{
+    const unsigned char *data = buffer->data;
+    for (uint64_t i = 0; i < buffer->size; i++)
+    {
+        if (data[i] != CHECK_BUFFER_FILL)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void process_queue(int32_t queue_id)
+{
+    dispatched_buffer = NULL;
+    int32_t n_events = 0;
+    CHECK(zz_event_process_events(queue_id, &n_events) == 0);
+}
+
+void check_pool_reuse(void)
+{
+    zz_event_buffer_t *buffer = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(buffer->capacity == 1ULL << ZZ_EVENT_BUFFER_MIN_SHIFT);
+    CHECK(buffer->fd == -1);
+    zz_event_buffer_release(buffer);
+
+    // Same capacity: the same buffer and mapping, with its old content
+    zz_event_buffer_t *reused = NULL;
+    CHECK(zz_event_buffer_alloc(CHECK_BUFFER_SIZE / 2, 0, &reused) == 0);
+    CHECK(reused == buffer);
+    CHECK(reused->size == CHECK_BUFFER_SIZE / 2);
+    CHECK(is_filled(reused));
+
+    // Another capacity or a shared buffer does not take it
+    zz_event_buffer_release(reused);
+    zz_event_buffer_t *larger = NULL;
+    CHECK(zz_event_buffer_alloc(2 * CHECK_BUFFER_SIZE, 0, &larger) == 0);
+    CHECK(larger != buffer);
+    CHECK(larger->capacity == 2ULL << ZZ_EVENT_BUFFER_MIN_SHIFT);
+    zz_event_buffer_t *shared = NULL;
+    CHECK(zz_event_buffer_alloc(CHECK_BUFFER_SIZE, ZZ_EVENT_BUFFER_SHARED, &shared) == 0);
+    CHECK(shared != buffer);
+    CHECK(shared->fd >= 0);
+    zz_event_buffer_release(larger);
+    zz_event_buffer_release(shared);
+    zz_event_buffer_pool_trim();
+}
+
+void check_pool_depth(void)
+{
+    zz_event_buffer_t *buffers[ZZ_EVENT_BUFFER_POOL_DEPTH + 1];
+    for (uint32_t i = 0; i <= ZZ_EVENT_BUFFER_POOL_DEPTH; i++)
+    {
+        CHECK(zz_event_buffer_alloc(CHECK_BUFFER_SIZE, 0, &buffers[i]) == 0);
+    }
+    // The last one does not fit in the pool and is unmapped
+    for (uint32_t i = 0; i <= ZZ_EVENT_BUFFER_POOL_DEPTH; i++)
+    {
+        zz_event_buffer_release(buffers[i]);
+    }
+
+    // Last released, first reused
+    for (uint32_t i = 0; i < ZZ_EVENT_BUFFER_POOL_DEPTH; i++)
+    {
+        zz_event_buffer_t *reused = NULL;
+        CHECK(zz_event_buffer_alloc(CHECK_BUFFER_SIZE, 0, &reused) == 0);
+        CHECK(reused == buffers[ZZ_EVENT_BUFFER_POOL_DEPTH - 1 - i]);
+    }
+    for (uint32_t i = 0; i < ZZ_EVENT_BUFFER_POOL_DEPTH; i++)
+    {
+        zz_event_buffer_release(buffers[i]);
+    }
+    zz_event_buffer_pool_trim();
+}
+
+void check_event_release(void)
+{
+    // Dispatched
+    zz_event_buffer_t *buffer = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(zz_event_post_buffer(CHECK_QUEUE, CHECK_EVENT_BUFFER, buffer, NULL) == 0);
+    process_queue(CHECK_QUEUE);
+    CHECK(dispatched_buffer == buffer);
+    zz_event_buffer_t *reused = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(reused == buffer);
+
+    // Cancelled, released by the next processing of the queue
+    uint32_t uuid = 0;
+    CHECK(zz_event_post_buffer(CHECK_QUEUE, CHECK_EVENT_BUFFER, reused, &uuid) == 0);
+    CHECK(zz_event_cancel(CHECK_QUEUE, uuid) == 0);
+    process_queue(CHECK_QUEUE);
+    CHECK(dispatched_buffer == NULL);
+    reused = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(reused == buffer);
+
+    // Refused by a missing queue, still owned by the event module
+    CHECK(zz_event_post_buffer(CHECK_QUEUE_FORWARD + 1, CHECK_EVENT_BUFFER, reused, NULL) != 0);
+    reused = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(reused == buffer);
+    zz_event_buffer_release(reused);
+}
+
+void check_buffer_take(void)
+{
+    zz_event_buffer_t *buffer = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(zz_event_post_buffer(CHECK_QUEUE, CHECK_EVENT_TAKE, buffer, NULL) == 0);
+    process_queue(CHECK_QUEUE);
+    CHECK(taken_buffer == buffer);
+
+    // Kept by the callback, out of the pool and untouched
+    zz_event_buffer_t *other = alloc_filled(CHECK_BUFFER_SIZE);
+    CHECK(other != buffer);
+    zz_event_buffer_release(other);
+    CHECK(is_filled(buffer));
+
+    // Forwarded as it is to another queue
+    CHECK(zz_event_post_buffer(CHECK_QUEUE_FORWARD, CHECK_EVENT_BUFFER, taken_buffer, NULL) == 0);
+    process_queue(CHECK_QUEUE_FORWARD);
+    CHECK(dispatched_buffer == buffer);
+}
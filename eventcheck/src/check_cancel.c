@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <zz_event.h>
+
+#include "check.h"
+
+/**
+ * Checks the cancellation of pending events by uuid and by type. An event
+ * cancelled while the consumer of its queue is running is either cancelled
+ * or dispatched, never both, and it is always released.
+ */
+
+/// Queue of the cancelled events
+#define CHECK_QUEUE 1
+/// Queue never created
+#define CHECK_QUEUE_MISSING 2
+/// Event types posted in turns
+#define CHECK_EVENT_KEEP 1
+#define CHECK_EVENT_DROP 2
+/// Events posted while nothing is processed
+#define CHECK_EVENTS 32
+/// Events posted while the consumer is running
+#define CHECK_RACE_EVENTS 20000
+/// Distance between the event posted and the one cancelled in the race
+#define CHECK_RACE_LAG 8
+
+/// Times every event was dispatched, by payload
+static uint8_t n_dispatches[CHECK_RACE_EVENTS];
+
+static atomic_uint n_released = 0;
+
+static atomic_bool stop_consumer = false;
+
+void count_dispatch(
+    zz_event_list_t *event);
+
+void count_release(
+    void *data);
+
+int post_indexed_event(
+    uint32_t event_type,
+    uint32_t index,
+    uint32_t *uuid);
+
+void *consumer_loop(
+    void *data);
+
+void check_cancel_pending(void);
+
+void check_cancel_race(void);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_KEEP, &count_dispatch);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_DROP, &count_dispatch);
+
+    check_cancel_pending();
+    check_cancel_race();
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void count_dispatch(zz_event_list_t *event)
+{
+    uint32_t index = *(const uint32_t *)zz_event_data(event);
+    if (index < CHECK_RACE_EVENTS)
+    {
+        n_dispatches[index]++;
+    }
+}
+
+void count_release(void *data)
+{
+    (void)data;
+    atomic_fetch_add(&n_released, 1);
+}
+
+int post_indexed_event(uint32_t event_type, uint32_t index, uint32_t *uuid)
+{
+    zz_event_list_t *event = NULL;
+    if (zz_event_alloc_event(event_type, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, sizeof(index), &event) != 0)
+    {
+        return 1;
+    }
+    memcpy(zz_event_data(event), &index, sizeof(index));
+    event->data_destructor = &count_release;
+
+    return zz_event_post_event(CHECK_QUEUE, event, uuid);
+}
+
+void *consumer_loop(void *data)
+{
+    (void)data;
+    int32_t n_events = 0;
+    while (!atomic_load(&stop_consumer))
+    {
+        zz_event_process_events(CHECK_QUEUE, &n_events);
+    }
+    zz_event_process_events(CHECK_QUEUE, &n_events);
+
+    return NULL;
+}
+
+void check_cancel_pending(void)
+{
+    memset(n_dispatches, 0, sizeof(n_dispatches));
+    atomic_store(&n_released, 0);
+
+    uint32_t uuids[CHECK_EVENTS];
+    for (uint32_t i = 0; i < CHECK_EVENTS; i++)
+    {
+        CHECK(post_indexed_event(i % 2 ? CHECK_EVENT_DROP : CHECK_EVENT_KEEP, i, &uuids[i]) == 0);
+        CHECK(uuids[i] != 0);
+    }
+
+    // Every third event by uuid, half of them of the type cancelled next
+    uint32_t n_cancelled_drop = 0;
+    for (uint32_t i = 0; i < CHECK_EVENTS; i += 3)
+    {
+        CHECK(zz_event_cancel(CHECK_QUEUE, uuids[i]) == 0);
+        CHECK(zz_event_cancel(CHECK_QUEUE, uuids[i]) != 0);
+        n_cancelled_drop += i % 2;
+    }
+    CHECK(zz_event_cancel(CHECK_QUEUE, 0) != 0);
+    CHECK(zz_event_cancel(CHECK_QUEUE_MISSING, uuids[1]) != 0);
+
+    uint32_t n_cancelled = 0;
+    CHECK(zz_event_cancel_by_type(CHECK_QUEUE, CHECK_EVENT_DROP, &n_cancelled) == 0);
+    CHECK(n_cancelled == CHECK_EVENTS / 2 - n_cancelled_drop);
+    CHECK(zz_event_cancel_by_type(CHECK_QUEUE, CHECK_EVENT_DROP, &n_cancelled) == 0);
+    CHECK(n_cancelled == 0);
+    CHECK(zz_event_cancel_by_type(CHECK_QUEUE_MISSING, CHECK_EVENT_DROP, &n_cancelled) != 0);
+
+    int32_t n_events = 0;
+    CHECK(zz_event_process_events(CHECK_QUEUE, &n_events) == 0);
+    for (uint32_t i = 0; i < CHECK_EVENTS; i++)
+    {
+        bool kept = i % 2 == 0 && i % 3 != 0;
+        CHECK(n_dispatches[i] == kept);
+    }
+    CHECK(atomic_load(&n_released) == CHECK_EVENTS);
+
+    // A dispatched event can not be cancelled anymore
+    CHECK(zz_event_cancel(CHECK_QUEUE, uuids[2]) != 0);
+}
+
+void check_cancel_race(void)
+{
+    memset(n_dispatches, 0, sizeof(n_dispatches));
+    atomic_store(&n_released, 0);
+    atomic_store(&stop_consumer, false);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, &consumer_loop, NULL);
+
+    static uint32_t uuids[CHECK_RACE_EVENTS];
+    static bool cancelled[CHECK_RACE_EVENTS];
+    memset(cancelled, 0, sizeof(cancelled));
+    for (uint32_t i = 0; i < CHECK_RACE_EVENTS; i++)
+    {
+        CHECK(post_indexed_event(CHECK_EVENT_KEEP, i, &uuids[i]) == 0);
+        if (i >= CHECK_RACE_LAG)
+        {
+            uint32_t target = i - CHECK_RACE_LAG;
+            cancelled[target] = zz_event_cancel(CHECK_QUEUE, uuids[target]) == 0;
+        }
+    }
+
+    atomic_store(&stop_consumer, true);
+    pthread_join(consumer, NULL);
+
+    uint32_t n_failures = 0;
+    for (uint32_t i = 0; i < CHECK_RACE_EVENTS; i++)
+    {
+        if (n_dispatches[i] + cancelled[i] != 1)
+        {
+            n_failures++;
+        }
+    }
+    CHECK(n_failures == 0);
+    CHECK(atomic_load(&n_released) == CHECK_RACE_EVENTS);
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <pthread.h>
+
+#include <zz_event.h>
+#include <zz_event_buffer.h>
+#include <zz_event_capture.h>
+
+#include "check.h"
+
+/**
+ * Captures the events posted by several threads, replays the capture and
+ * checks that the same events are dispatched again. The events refused by
+ * their queue must not be in the capture.
+ */
+
+/// Queues of the capture
+#define CHECK_QUEUE_A 1
+#define CHECK_QUEUE_B 2
+/// Queue never created, its events are refused
+#define CHECK_QUEUE_MISSING 3
+/// Threads posting at the same time
+#define CHECK_PRODUCERS 4
+/// Iterations of every producer
+#define CHECK_ITERATIONS 5000
+/// Event type carrying an integer
+#define CHECK_EVENT_VALUE 1
+/// Event type carrying a buffer
+#define CHECK_EVENT_BUFFER 2
+/// Capture file, created in the working directory
+#define CHECK_CAPTURE_PATH "zzevent_check_capture.bin"
+
+/**
+ * @brief The events dispatched by a queue, regardless of their order
+ */
+typedef struct queue_digest_t
+{
+    uint64_t n_events;
+    /// Sum of the hashes of the events
+    uint64_t sum;
+} queue_digest_t;
+
+static queue_digest_t digests[2];
+
+void *producer_loop(
+    void *data);
+
+void digest_event(
+    zz_event_list_t *event,
+    void *ctx);
+
+uint64_t hash_bytes(
+    uint64_t hash,
+    const void *data,
+    uint64_t size);
+
+void process_queues(void);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE_A);
+    zz_event_create_queue(CHECK_QUEUE_B);
+    zz_event_register_event_mask_callback(CHECK_QUEUE_A, 0, 0, &digest_event, &digests[0]);
+    zz_event_register_event_mask_callback(CHECK_QUEUE_B, 0, 0, &digest_event, &digests[1]);
+
+    // The content of the buffers is needed to compare them after the replay
+    zz_event_capture_set_buffer_content(true);
+    CHECK(zz_event_capture_start(CHECK_CAPTURE_PATH) == 0);
+
+    pthread_t producers[CHECK_PRODUCERS];
+    uint64_t n_accepted[CHECK_PRODUCERS] = {0};
+    for (uint32_t i = 0; i < CHECK_PRODUCERS; i++)
+    {
+        n_accepted[i] = i;
+        pthread_create(&producers[i], NULL, &producer_loop, &n_accepted[i]);
+    }
+    uint64_t n_posted = 0;
+    for (uint32_t i = 0; i < CHECK_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+        n_posted += n_accepted[i];
+    }
+    CHECK(zz_event_capture_stop() == 0);
+    CHECK(!zz_event_capture_is_active());
+
+    process_queues();
+    queue_digest_t captured[2];
+    memcpy(captured, digests, sizeof(digests));
+    CHECK(captured[0].n_events + captured[1].n_events == n_posted);
+
+    int32_t queue_ids[4];
+    uint32_t n_queues = 0;
+    uint64_t n_trace_events = 0;
+    CHECK(zz_event_capture_scan(CHECK_CAPTURE_PATH, queue_ids, 4, &n_queues, &n_trace_events) == 0);
+    CHECK(n_queues == 2);
+    CHECK(n_trace_events == n_posted);
+
+    memset(digests, 0, sizeof(digests));
+    uint64_t n_replayed = 0;
+    CHECK(zz_event_replay(CHECK_CAPTURE_PATH, 0, &n_replayed) == 0);
+    CHECK(n_replayed == n_posted);
+    process_queues();
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        CHECK(digests[i].n_events == captured[i].n_events);
+        CHECK(digests[i].sum == captured[i].sum);
+    }
+
+    zz_event_deinit();
+    remove(CHECK_CAPTURE_PATH);
+
+    return CHECK_RESULT();
+}
+
+void *producer_loop(void *data)
+{
+    // Holds the index of the producer, then the number of events accepted
+    uint64_t *n_accepted = data;
+    uint64_t producer = *n_accepted;
+    *n_accepted = 0;
+
+    for (uint64_t i = 0; i < CHECK_ITERATIONS; i++)
+    {
+        uint64_t values[3] = {producer << 32 | i, i, ~i};
+        int32_t queue_id = i % 2 ? CHECK_QUEUE_A : CHECK_QUEUE_B;
+        uint32_t n_events = 1 + (uint32_t)(i % 3);
+        if (zz_event_create_events_in_queue(queue_id, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT,
+                                            values, sizeof(values[0]), n_events) == 0)
+        {
+            *n_accepted += n_events;
+        }
+
+        if (i % 10 == 0)
+        {
+            zz_event_create_event_in_queue(CHECK_QUEUE_MISSING, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT,
+                                           values, sizeof(values[0]), NULL);
+        }
+
+        if (i % 100 == 0)
+        {
+            zz_event_buffer_t *buffer = NULL;
+            if (zz_event_buffer_alloc(100 + i % 50, 0, &buffer) == 0)
+            {
+                memset(buffer->data, (int)(i + producer), buffer->size);
+                if (zz_event_post_buffer(CHECK_QUEUE_A, CHECK_EVENT_BUFFER, buffer, NULL) == 0)
+                {
+                    (*n_accepted)++;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void digest_event(zz_event_list_t *event, void *ctx)
+{
+    queue_digest_t *digest = ctx;
+    uint64_t hash = hash_bytes(14695981039346656037ULL, &event->event_type, sizeof(event->event_type));
+
+    zz_event_buffer_t *buffer = zz_event_buffer_from_event(event);
+    if (buffer)
+    {
+        hash = hash_bytes(hash, buffer->data, buffer->size);
+    }
+    else
+    {
+        hash = hash_bytes(hash, zz_event_data(event), event->data_size);
+    }
+
+    digest->n_events++;
+    digest->sum += hash;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, uint64_t size)
+{
+    // FNV-1a
+    const unsigned char *bytes = data;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+void process_queues(void)
+{
+    int32_t n_events = 0;
+    zz_event_process_events(CHECK_QUEUE_A, &n_events);
+    zz_event_process_events(CHECK_QUEUE_B, &n_events);
+}
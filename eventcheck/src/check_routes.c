@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <zz_event.h>
+#include <zz_event_route.h>
+
+#include "check.h"
+
+/**
+ * Checks the order of the callbacks matching an event: the one of the exact
+ * event type first, then the wildcards in registration order. The event
+ * types out of the routing tables, more than the wildcard cache can hold,
+ * must reach the same wildcards.
+ */
+
+/// Queue of the routes
+#define CHECK_QUEUE 1
+/// Range of event types [CHECK_RANGE_FIRST, CHECK_RANGE_LAST]
+#define CHECK_RANGE_FIRST 100
+#define CHECK_RANGE_LAST 5000
+/// Event types where (type & CHECK_MASK) == CHECK_MASK_VALUE
+#define CHECK_MASK 0xF
+#define CHECK_MASK_VALUE 0x5
+/// Event type with an exact callback, in the range and the mask
+#define CHECK_EVENT_EXACT 101
+/// First event type of the ones out of the routing tables
+#define CHECK_EVENT_FAR 0x100000
+/// Far event types posted, more than the wildcard cache holds
+#define CHECK_FAR_TYPES (2 * ZZ_EVENT_ROUTE_CACHE_SIZE)
+
+/// Maximum callbacks logged for one event
+#define CHECK_LOG_SIZE 8
+
+/// Tags of the callbacks, logged when they are called
+static const char tag_exact = 'E';
+static const char tag_range = 'R';
+static const char tag_range_again = 'r';
+static const char tag_mask = 'M';
+
+/// The tags of the callbacks called for the last event
+static char dispatch_log[CHECK_LOG_SIZE + 1];
+
+static uint32_t n_logged = 0;
+
+void log_callback(
+    zz_event_list_t *event,
+    void *ctx);
+
+const char *dispatch_type(
+    uint32_t event_type);
+
+void dispatch_far_types(
+    uint32_t *n_range,
+    uint32_t *n_mask);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE);
+
+    // The exact callback is registered last and still called first
+    zz_event_register_event_range_callback(CHECK_QUEUE, CHECK_RANGE_FIRST, CHECK_RANGE_LAST, &log_callback,
+                                           (void *)&tag_range);
+    zz_event_register_event_mask_callback(CHECK_QUEUE, CHECK_MASK, CHECK_MASK_VALUE, &log_callback,
+                                          (void *)&tag_mask);
+    zz_event_register_event_type_ctx_callback(CHECK_QUEUE, CHECK_EVENT_EXACT, &log_callback, (void *)&tag_exact);
+
+    CHECK(strcmp(dispatch_type(CHECK_EVENT_EXACT), "ERM") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_RANGE_FIRST), "R") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_RANGE_LAST), "R") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_MASK_VALUE), "M") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_RANGE_LAST + 1), "") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_RANGE_LAST + 0x10 - (CHECK_RANGE_LAST & CHECK_MASK) + CHECK_MASK_VALUE), "M") == 0);
+
+    // Twice, the second time from the wildcard cache when it holds them
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        uint32_t n_range = 0;
+        uint32_t n_mask = 0;
+        dispatch_far_types(&n_range, &n_mask);
+        CHECK(n_range == 0);
+        CHECK(n_mask == CHECK_FAR_TYPES / (CHECK_MASK + 1));
+    }
+
+    // The same range again replaces its callback
+    zz_event_register_event_range_callback(CHECK_QUEUE, CHECK_RANGE_FIRST, CHECK_RANGE_LAST, &log_callback,
+                                           (void *)&tag_range_again);
+    CHECK(strcmp(dispatch_type(CHECK_RANGE_FIRST), "r") == 0);
+
+    zz_event_remove_event_mask_callback(CHECK_QUEUE, CHECK_MASK, CHECK_MASK_VALUE);
+    CHECK(strcmp(dispatch_type(CHECK_EVENT_EXACT), "Er") == 0);
+    CHECK(strcmp(dispatch_type(CHECK_MASK_VALUE), "") == 0);
+
+    zz_event_remove_event_type_callback(CHECK_QUEUE, CHECK_EVENT_EXACT);
+    CHECK(strcmp(dispatch_type(CHECK_EVENT_EXACT), "r") == 0);
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void log_callback(zz_event_list_t *event, void *ctx)
+{
+    (void)event;
+    if (n_logged < CHECK_LOG_SIZE)
+    {
+        dispatch_log[n_logged] = *(const char *)ctx;
+    }
+    n_logged++;
+}
+
+const char *dispatch_type(uint32_t event_type)
+{
+    memset(dispatch_log, 0, sizeof(dispatch_log));
+    n_logged = 0;
+
+    int32_t n_events = 0;
+    CHECK(zz_event_create_event_in_queue(CHECK_QUEUE, event_type, ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0, NULL) == 0);
+    CHECK(zz_event_process_events(CHECK_QUEUE, &n_events) == 0);
+    CHECK(n_events == 1);
+
+    return dispatch_log;
+}
+
+void dispatch_far_types(uint32_t *n_range, uint32_t *n_mask)
+{
+    for (uint32_t i = 0; i < CHECK_FAR_TYPES; i++)
+    {
+        const char *log = dispatch_type(CHECK_EVENT_FAR + i);
+        *n_range += strchr(log, tag_range) != NULL;
+        *n_mask += strchr(log, tag_mask) != NULL;
+        CHECK(n_logged == ((i & CHECK_MASK) == CHECK_MASK_VALUE));
+    }
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <zz_event.h>
+#include <zz_event_runtime.h>
+
+#include "check.h"
+
+/**
+ * Runs several queues fed by several producers on the runtime workers, and
+ * checks that the callbacks of a queue never run on two workers at once and
+ * that zz_event_runtime_wait_idle returns once every event, urgent or not,
+ * was dispatched.
+ */
+
+/// Queues attached to the runtime, with ids 1 to CHECK_QUEUES
+#define CHECK_QUEUES 3
+/// Runtime worker threads, more than the queues
+#define CHECK_WORKERS 4
+/// Events of a queue per turn, small so the queues move between workers
+#define CHECK_EVENTS_PER_TURN 8
+/// Threads posting at the same time
+#define CHECK_PRODUCERS 4
+/// Events posted by every producer
+#define CHECK_ITERATIONS 5000
+/// Event type of all the events
+#define CHECK_EVENT_WORK 1
+
+/**
+ * @brief The dispatches of a queue
+ */
+typedef struct queue_state_t
+{
+    /// Callbacks of the queue running right now
+    atomic_uint n_running;
+    /// Times a callback started while another one of the queue was running
+    atomic_uint n_overlaps;
+    atomic_uint_fast64_t n_dispatched;
+} queue_state_t;
+
+static queue_state_t queue_states[CHECK_QUEUES];
+
+void run_event(
+    zz_event_list_t *event,
+    void *ctx);
+
+void *producer_loop(
+    void *data);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    for (int32_t i = 0; i < CHECK_QUEUES; i++)
+    {
+        zz_event_create_queue(i + 1);
+        zz_event_register_event_type_ctx_callback(i + 1, CHECK_EVENT_WORK, &run_event, &queue_states[i]);
+    }
+
+    CHECK(zz_event_runtime_start(CHECK_WORKERS, CHECK_EVENTS_PER_TURN) == 0);
+    CHECK(zz_event_runtime_is_running());
+    for (int32_t i = 0; i < CHECK_QUEUES; i++)
+    {
+        CHECK(zz_event_runtime_attach(i + 1) == 0);
+    }
+
+    pthread_t producers[CHECK_PRODUCERS];
+    uint64_t n_posted[CHECK_PRODUCERS] = {0};
+    for (uint32_t i = 0; i < CHECK_PRODUCERS; i++)
+    {
+        pthread_create(&producers[i], NULL, &producer_loop, &n_posted[i]);
+    }
+    uint64_t n_total = 0;
+    for (uint32_t i = 0; i < CHECK_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+        n_total += n_posted[i];
+    }
+
+    CHECK(zz_event_runtime_wait_idle() == 0);
+    uint64_t n_dispatched = 0;
+    for (uint32_t i = 0; i < CHECK_QUEUES; i++)
+    {
+        CHECK(atomic_load(&queue_states[i].n_overlaps) == 0);
+        n_dispatched += atomic_load(&queue_states[i].n_dispatched);
+    }
+    CHECK(n_dispatched == n_total);
+    uint64_t n_processed = 0;
+    CHECK(zz_event_runtime_get_processed(&n_processed) == 0);
+    CHECK(n_processed == n_total);
+
+    for (int32_t i = 0; i < CHECK_QUEUES; i++)
+    {
+        CHECK(zz_event_runtime_detach(i + 1) == 0);
+    }
+    CHECK(zz_event_runtime_stop() == 0);
+    CHECK(!zz_event_runtime_is_running());
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void run_event(zz_event_list_t *event, void *ctx)
+{
+    (void)event;
+    queue_state_t *state = ctx;
+    if (atomic_fetch_add(&state->n_running, 1) != 0)
+    {
+        atomic_fetch_add(&state->n_overlaps, 1);
+    }
+
+    // Long enough for another worker to pick the queue if it could
+    volatile uint32_t work = 0;
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        work += i;
+    }
+
+    atomic_fetch_add(&state->n_dispatched, 1);
+    atomic_fetch_sub(&state->n_running, 1);
+}
+
+void *producer_loop(void *data)
+{
+    uint64_t *n_posted = data;
+    for (uint32_t i = 0; i < CHECK_ITERATIONS; i++)
+    {
+        int32_t queue_id = 1 + (int32_t)(i % CHECK_QUEUES);
+        int err = 0;
+        if (i % 50 == 0)
+        {
+            // The urgent lane can be full, such events are not counted
+            err = zz_event_post_urgent_event(queue_id, CHECK_EVENT_WORK, ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0);
+        }
+        else
+        {
+            err = zz_event_create_event_in_queue(queue_id, CHECK_EVENT_WORK, ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL, 0,
+                                                 NULL);
+        }
+        *n_posted += err == 0;
+    }
+
+    return NULL;
+}
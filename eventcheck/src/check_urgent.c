@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include <semaphore.h>
+
+#include <zz_event.h>
+
+#include "check.h"
+
+/**
+ * Checks that the urgent events are dispatched before the pending ones, in
+ * the order they were posted, that the lane refuses events once full, and
+ * that an urgent event posted from a signal handler posts the semaphore of
+ * its queue.
+ */
+
+/// Queue of the urgent events
+#define CHECK_QUEUE 1
+/// Queue never created
+#define CHECK_QUEUE_MISSING 2
+/// Event type of all the events, urgent or not
+#define CHECK_EVENT_VALUE 1
+/// Value of the event that posts an urgent event when it is dispatched
+#define CHECK_VALUE_TRIGGER 1
+/// Value of the urgent event posted by the dispatch of CHECK_VALUE_TRIGGER
+#define CHECK_VALUE_TRIGGERED 13
+/// Maximum events logged
+#define CHECK_LOG_SIZE 64
+
+/// The values of the events in the order they were dispatched
+static uint32_t dispatch_log[CHECK_LOG_SIZE];
+
+static uint32_t n_logged = 0;
+
+void log_event(
+    zz_event_list_t *event);
+
+void post_urgent_on_signal(
+    int signal_number);
+
+int post_urgent_value(
+    uint32_t value);
+
+uint32_t pending_urgent_events(void);
+
+void process_queue(void);
+
+void check_urgent_order(void);
+
+void check_urgent_capacity(void);
+
+void check_urgent_signal(void);
+
+int main(void)
+{
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(CHECK_QUEUE);
+    zz_event_register_event_type_callback(CHECK_QUEUE, CHECK_EVENT_VALUE, &log_event);
+
+    check_urgent_order();
+    check_urgent_capacity();
+    check_urgent_signal();
+
+    zz_event_deinit();
+
+    return CHECK_RESULT();
+}
+
+void log_event(zz_event_list_t *event)
+{
+    uint32_t value = *(const uint32_t *)zz_event_data(event);
+    if (n_logged < CHECK_LOG_SIZE)
+    {
+        dispatch_log[n_logged] = value;
+    }
+    n_logged++;
+
+    if (value == CHECK_VALUE_TRIGGER)
+    {
+        CHECK(post_urgent_value(CHECK_VALUE_TRIGGERED) == 0);
+    }
+}
+
+void post_urgent_on_signal(int signal_number)
+{
+    post_urgent_value((uint32_t)signal_number);
+}
+
+int post_urgent_value(uint32_t value)
+{
+    return zz_event_post_urgent_event(CHECK_QUEUE, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT, &value,
+                                      sizeof(value));
+}
+
+uint32_t pending_urgent_events(void)
+{
+    uint32_t n_events = UINT32_MAX;
+    CHECK(zz_event_get_pending_urgent_events(CHECK_QUEUE, &n_events) == 0);
+
+    return n_events;
+}
+
+void process_queue(void)
+{
+    memset(dispatch_log, 0, sizeof(dispatch_log));
+    n_logged = 0;
+
+    int32_t n_events = 0;
+    CHECK(zz_event_process_events(CHECK_QUEUE, &n_events) == 0);
+    CHECK((uint32_t)n_events == n_logged);
+}
+
+void check_urgent_order(void)
+{
+    for (uint32_t value = 1; value <= 3; value++)
+    {
+        CHECK(zz_event_create_event_in_queue(CHECK_QUEUE, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNSIGNED_INT,
+                                             &value, sizeof(value), NULL) == 0);
+    }
+    for (uint32_t value = 10; value <= 12; value++)
+    {
+        CHECK(post_urgent_value(value) == 0);
+    }
+    CHECK(pending_urgent_events() == 3);
+
+    // The urgent event posted while the first pending one is dispatched goes
+    // before the other pending ones
+    process_queue();
+    const uint32_t expected[] = {10, 11, 12, CHECK_VALUE_TRIGGER, CHECK_VALUE_TRIGGERED, 2, 3};
+    CHECK(n_logged == sizeof(expected) / sizeof(expected[0]));
+    CHECK(memcmp(dispatch_log, expected, sizeof(expected)) == 0);
+    CHECK(pending_urgent_events() == 0);
+}
+
+void check_urgent_capacity(void)
+{
+    for (uint32_t value = 100; value < 100 + ZZ_EVENT_URGENT_CAPACITY; value++)
+    {
+        CHECK(post_urgent_value(value) == 0);
+    }
+    CHECK(post_urgent_value(0) != 0);
+    CHECK(pending_urgent_events() == ZZ_EVENT_URGENT_CAPACITY);
+
+    char large[ZZ_EVENT_URGENT_MAX_DATA_SIZE + 1] = {0};
+    CHECK(zz_event_post_urgent_event(CHECK_QUEUE, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNDEFINED, large,
+                                     sizeof(large)) != 0);
+    CHECK(zz_event_post_urgent_event(CHECK_QUEUE_MISSING, CHECK_EVENT_VALUE, ZZ_EVENT_DATA_TYPE_UNDEFINED, NULL,
+                                     0) != 0);
+
+    process_queue();
+    CHECK(n_logged == ZZ_EVENT_URGENT_CAPACITY);
+    for (uint32_t i = 0; i < ZZ_EVENT_URGENT_CAPACITY; i++)
+    {
+        CHECK(dispatch_log[i] == 100 + i);
+    }
+    CHECK(post_urgent_value(0) == 0);
+    process_queue();
+}
+
+void check_urgent_signal(void)
+{
+    sem_t sem;
+    sem_init(&sem, 0, 0);
+    CHECK(zz_event_set_queue_urgent_semaphore(CHECK_QUEUE, &sem) == 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &post_urgent_on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    // raise returns once the handler ran
+    CHECK(raise(SIGUSR1) == 0);
+    CHECK(sem_trywait(&sem) == 0);
+    CHECK(pending_urgent_events() == 1);
+    process_queue();
+    CHECK(n_logged == 1);
+    CHECK(dispatch_log[0] == SIGUSR1);
+
+    CHECK(zz_event_set_queue_urgent_semaphore(CHECK_QUEUE, NULL) == 0);
+    CHECK(post_urgent_value(0) == 0);
+    CHECK(sem_trywait(&sem) != 0);
+    process_queue();
+
+    signal(SIGUSR1, SIG_DFL);
+    sem_destroy(&sem);
+}
@@ -1,25 +1,213 @@
 #include "zz_event.h"
+#include "zz_event_capture.h"
+#include "zz_event_trace.h"
+#include "zz_event_route.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stddef.h>
+
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
 
 #include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <utils.h>
+
+#ifndef ZZ_EVENT_QUEUE_SHARD_BITS
+/// Every queue has 2^ZZ_EVENT_QUEUE_SHARD_BITS producer shards
+#define ZZ_EVENT_QUEUE_SHARD_BITS 3
+#endif
+
+/// Number of producer shards of a queue
+#define EVENT_SHARDS (1u << ZZ_EVENT_QUEUE_SHARD_BITS)
+
+/// Shard of an event, kept in the low bits of its uuid
+#define UUID_SHARD(uuid) ((uuid) & (EVENT_SHARDS - 1))
+
+/// Position of an event in its shard, kept in the high bits of its uuid
+#define UUID_SEQ(uuid) ((uuid) >> ZZ_EVENT_QUEUE_SHARD_BITS)
+
+/// Size of the cache line, the unit the cores contend for
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief Events added to a queue by a subset of the producer threads
+ *
+ * Each producer thread always adds its events to the same shard, so the
+ * producers of a queue do not contend for the same lock and cache lines.
+ * The events of one producer keep their order.
+ */
+typedef struct event_shard_t
+{
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mtx;
+    /// The first pending event
+    zz_event_list_t *event_list;
+    /// The last pending event, to append in constant time
+    zz_event_list_t *event_list_tail;
+    /// Number of pending events in event_list. Written with the lock taken,
+    /// read without it by the consumer.
+    atomic_uint n_events;
+    /// Cancelled events still linked in event_list, released when the
+    /// consumer reaches them or by a later cancellation
+    uint32_t n_cancelled;
+    /// Sequence number of the next event, never 0
+    uint32_t next_seq;
+    /// Open addressing index of the pending events by uuid
+    zz_event_list_t **uuid_index;
+    /// Capacity of uuid_index minus one (capacity is a power of two)
+    uint32_t uuid_index_mask;
+} event_shard_t;
+
+/**
+ * @brief A preallocated slot of the urgent lane
+ */
+typedef struct urgent_slot_t
+{
+    /// Lane position the slot is free for, plus one once it is written
+    atomic_size_t seq;
+    uint32_t event_type;
+    zz_event_data_type_t data_type;
+    uint32_t data_size;
+    /// When the event was posted if the trace was running, 0 otherwise
+    uint64_t post_ns;
+    unsigned char data[ZZ_EVENT_URGENT_MAX_DATA_SIZE];
+} urgent_slot_t;
+
+/**
+ * @brief Bounded lock free ring of urgent events (D. Vyukov's bounded MPMC
+ * queue). Every position of the ring is claimed with a single CAS and
+ * published with the sequence number of its slot.
+ */
+typedef struct urgent_lane_t
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    urgent_slot_t slots[ZZ_EVENT_URGENT_CAPACITY];
+} urgent_lane_t;
+
+_Static_assert((ZZ_EVENT_URGENT_CAPACITY & (ZZ_EVENT_URGENT_CAPACITY - 1)) == 0,
+               "ZZ_EVENT_URGENT_CAPACITY must be a power of two");
+
+/**
+ * @brief An urgent event taken out of its slot, in the stack of the consumer
+ * while it is dispatched (no allocation, so taking it can not fail)
+ */
+typedef struct urgent_event_t
+{
+    _Alignas(ZZ_EVENT_DATA_ALIGN) unsigned char bytes[ZZ_EVENT_DATA_OFFSET + ZZ_EVENT_URGENT_MAX_DATA_SIZE];
+    /// Trace id of the event, it has no uuid
+    uint64_t trace_id;
+} urgent_event_t;
 
 typedef struct event_queue_item_t
 {
     zz_event_queue_t queue;
+    /// The pending events, by producer
+    event_shard_t shards[EVENT_SHARDS];
+    /// Events dispatched before the shards, added without locking
+    urgent_lane_t urgent;
+    /// Shard where the consumer looks for the next event
+    atomic_uint drain_shard;
+    /// Immutable snapshot of the callbacks of every event type, resolved from
+    /// queue.event_callback_list. Replaced as a whole on every registration.
+    _Atomic(zz_event_route_table_t *) route_table;
+    /// Replaced routing tables, released when no thread is dispatching
+    zz_event_route_table_t *retired_route_tables;
+    /// True while retired_route_tables is not empty
+    atomic_bool has_retired_routes;
+    /// Number of threads running zz_event_process_events for this queue
+    atomic_uint n_dispatching;
+    /// Phase the threads starting to dispatch count themselves in, flipped by
+    /// zz_event_wait_dispatching so the threads it waits for can drain
+    atomic_uint dispatch_phase;
+    /// Number of threads dispatching this queue, by the phase they started in
+    atomic_uint n_phase_dispatching[2];
+    /// Serializes the flips of zz_event_wait_dispatching
+    pthread_mutex_t wait_dispatching_mtx;
+    /// Notified when an event is added to the queue (optional)
+    zz_event_ready_callback *ready_callback;
+    /// The context given to ready_callback
+    void *ready_ctx;
+    /// Posted when an urgent event is added to the queue (optional)
+    _Atomic(sem_t *) urgent_sem;
+    /// How zz_event_wait_events waits for this queue
+    zz_event_wait_strategy_t wait_strategy;
+    /// True while the consumer sleeps on wake_sem, the producers only post it
+    /// when they see this flag set
+    atomic_bool parked;
+    /// Wakes up the parked consumer
+    sem_t wake_sem;
+    /// Protects the callbacks and the settings of the queue
     pthread_mutex_t mtx;
 } event_queue_item_t;
 
+/// Hint to the CPU that the thread is spinning (saves power and lets the
+/// sibling hyperthread run)
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define CPU_PAUSE() ((void)0)
+#endif
+
+/// Initial capacity of the uuid index of a queue
+#define UUID_INDEX_INITIAL_SIZE 64
+
+/// The event was cancelled while linked in a shard, it is skipped and released
+#define EVENT_FLAG_CANCELLED 0x1
+
+/// The event is an urgent_event_t, dispatched alone and never released
+#define EVENT_FLAG_URGENT 0x2
+
+_Static_assert(ZZ_EVENT_DATA_ALIGN % _Alignof(max_align_t) == 0,
+               "ZZ_EVENT_DATA_ALIGN must keep the payload aligned to max_align_t");
+
 static event_queue_item_t event_queues[ZZ_EVENT_EVENT_MAX_EVENT_QUEUE];
 
 static pthread_mutex_t queue_list_mtx;
 
+/// Largest distance between a queue and the slot of its id, the lookups of
+/// missing ids stop there instead of scanning all the slots
+static atomic_int max_queue_probe = 0;
+
+static atomic_bool verbose = true;
+
+/**
+ * @brief A zz_event_process_events call running in the calling thread
+ *
+ * Lives in the stack of the call. zz_event_wait_dispatching does not wait for
+ * the calls of its own thread (it is called from a callback).
+ */
+typedef struct dispatch_frame_t
+{
+    event_queue_item_t *queue_item;
+    uint32_t phase;
+    struct dispatch_frame_t *prev;
+} dispatch_frame_t;
+
+/// The innermost zz_event_process_events call of the calling thread
+static _Thread_local dispatch_frame_t *dispatch_frames = NULL;
+
+/// Shard used by the calling thread, assigned on its first event
+static _Thread_local uint32_t producer_shard = UINT32_MAX;
+
+/// Spreads the producer threads over the shards
+static atomic_uint next_producer_shard = 0;
+
+static const zz_event_wait_strategy_t default_wait_strategy = {
+    ZZ_EVENT_WAIT_PARK, ZZ_EVENT_WAIT_DEFAULT_SPIN, ZZ_EVENT_WAIT_DEFAULT_YIELD};
+
 // Private prototypes
-int32_t get_next_free_queue(void);
+int32_t get_next_free_queue(
+    int32_t queue_id);
 
 event_queue_item_t *get_queue_item_by_id(
     int32_t queue_id);
@@ -34,17 +222,121 @@ int delete_event_list(
         zz_event_list_t **event_list);
 
 int remove_callback_from_list(
-    zz_event_callback_list_t *event_list,
-    uint32_t event_type);
+    zz_event_queue_t *queue,
+    const zz_event_callback_list_t *pattern);
+
+int register_callback(
+    int32_t queue_id,
+    const zz_event_callback_list_t *pattern);
+
+int remove_callback(
+    int32_t queue_id,
+    const zz_event_callback_list_t *pattern,
+    bool match_ctx);
 
 zz_event_callback_list_t *get_event_callback(
     zz_event_queue_t *queue,
-    uint32_t event_type);
+    const zz_event_callback_list_t *pattern);
+
+int rebuild_routes(
+    event_queue_item_t *queue_item);
+
+void free_retired_routes(
+    event_queue_item_t *queue_item);
 
-int add_event_to_queue(
+int add_events_to_queue(
     int32_t queue_id,
+    zz_event_list_t *const *events,
+    uint32_t n_events,
+    uint32_t *uuid);
+
+void link_event(
+    event_shard_t *shard,
+    zz_event_list_t *event);
+
+uint32_t get_producer_shard(void);
+
+void lock_shards(
+    event_queue_item_t *queue_item);
+
+void unlock_shards(
+    event_queue_item_t *queue_item);
+
+uint32_t queue_pending(
+    event_queue_item_t *queue_item);
+
+void refresh_dispatch_phase(
+    dispatch_frame_t *frame);
+
+zz_event_list_t *pop_event(
+    event_queue_item_t *queue_item,
+    const zz_event_list_t *batch_event,
+    urgent_event_t *urgent_event);
+
+zz_event_list_t *pop_shard_event(
+    event_shard_t *shard);
+
+zz_event_list_t *pop_urgent_event(
+    event_queue_item_t *queue_item,
+    urgent_event_t *urgent_event);
+
+void reset_urgent_lane(
+    urgent_lane_t *lane);
+
+zz_event_list_t *shift_event(
+    event_shard_t *shard);
+
+void retire_event(
+    event_shard_t *shard,
+    zz_event_list_t *event);
+
+void cancel_event(
+    event_shard_t *shard,
+    zz_event_list_t *event);
+
+void sweep_cancelled_events(
+    event_shard_t *shard,
+    zz_event_list_t **cancelled);
+
+int uuid_index_insert(
+    event_shard_t *shard,
     zz_event_list_t *event);
 
+void uuid_index_place(
+    zz_event_list_t **index,
+    uint32_t mask,
+    zz_event_list_t *event);
+
+int64_t uuid_index_find(
+    event_shard_t *shard,
+    uint32_t uuid);
+
+void uuid_index_remove(
+    event_shard_t *shard,
+    uint32_t uuid);
+
+void dispatch_event(
+    event_queue_item_t *queue_item,
+    zz_event_list_t *event);
+
+void dispatch_batch(
+    int32_t queue_id,
+    const zz_event_route_t *route,
+    zz_event_list_t **events,
+    uint32_t n_events,
+    bool tracing);
+
+void wake_consumer(
+    event_queue_item_t *queue_item);
+
+uint32_t park_consumer(
+    event_queue_item_t *queue_item,
+    uint64_t deadline_ns);
+
+int sleep_until(
+    sem_t *sem,
+    uint64_t deadline_ns);
+
 // Public implementation
 int zz_event_init(void)
 {
@@ -55,6 +347,34 @@ int zz_event_init(void)
         event_queues[i].queue.event_callback_list = NULL;
         event_queues[i].queue.event_list = NULL;
         event_queues[i].queue.id = ZZ_EVENT_QUEUE_ID_UNSET;
+        for (uint32_t j = 0; j < EVENT_SHARDS; j++)
+        {
+            event_shard_t *shard = &event_queues[i].shards[j];
+            shard->event_list = NULL;
+            shard->event_list_tail = NULL;
+            atomic_init(&shard->n_events, 0);
+            shard->n_cancelled = 0;
+            shard->next_seq = 1;
+            shard->uuid_index = NULL;
+            shard->uuid_index_mask = 0;
+            pthread_mutex_init(&shard->mtx, NULL);
+        }
+        atomic_init(&event_queues[i].drain_shard, 0);
+        reset_urgent_lane(&event_queues[i].urgent);
+        atomic_init(&event_queues[i].route_table, NULL);
+        event_queues[i].retired_route_tables = NULL;
+        atomic_init(&event_queues[i].has_retired_routes, false);
+        atomic_init(&event_queues[i].n_dispatching, 0);
+        atomic_init(&event_queues[i].dispatch_phase, 0);
+        atomic_init(&event_queues[i].n_phase_dispatching[0], 0);
+        atomic_init(&event_queues[i].n_phase_dispatching[1], 0);
+        pthread_mutex_init(&event_queues[i].wait_dispatching_mtx, NULL);
+        event_queues[i].ready_callback = NULL;
+        event_queues[i].ready_ctx = NULL;
+        atomic_init(&event_queues[i].urgent_sem, NULL);
+        event_queues[i].wait_strategy = default_wait_strategy;
+        atomic_init(&event_queues[i].parked, false);
+        sem_init(&event_queues[i].wake_sem, 0, 0);
 
         pthread_mutex_init(&event_queues[i].mtx, NULL);
     }
@@ -68,6 +388,12 @@ int zz_event_deinit(void)
     {
         delete_queue(&(event_queues[i]));
         pthread_mutex_destroy(&event_queues[i].mtx);
+        sem_destroy(&event_queues[i].wake_sem);
+        pthread_mutex_destroy(&event_queues[i].wait_dispatching_mtx);
+        for (uint32_t j = 0; j < EVENT_SHARDS; j++)
+        {
+            pthread_mutex_destroy(&event_queues[i].shards[j].mtx);
+        }
     }
 
     pthread_mutex_destroy(&queue_list_mtx);
@@ -75,6 +401,12 @@ int zz_event_deinit(void)
     return 0;
 }
 
+void zz_event_set_verbose(
+    bool enabled)
+{
+    atomic_store_explicit(&verbose, enabled, memory_order_relaxed);
+}
+
 int zz_event_create_queue(
     int32_t queue_id)
 {
@@ -93,7 +425,7 @@ int zz_event_create_queue(
         return 1;
     }
 
-    int32_t free_queue = get_next_free_queue();
+    int32_t free_queue = get_next_free_queue(queue_id);
     if (free_queue < 0)
     {
         pthread_mutex_unlock(&queue_list_mtx);
@@ -102,6 +434,11 @@ int zz_event_create_queue(
     }
 
     event_queues[free_queue].queue.id = queue_id;
+    int probe = (int)(((uint32_t)free_queue + ZZ_EVENT_EVENT_MAX_EVENT_QUEUE - (uint32_t)queue_id % ZZ_EVENT_EVENT_MAX_EVENT_QUEUE) % ZZ_EVENT_EVENT_MAX_EVENT_QUEUE);
+    if (probe > atomic_load(&max_queue_probe))
+    {
+        atomic_store(&max_queue_probe, probe);
+    }
 
     pthread_mutex_unlock(&queue_list_mtx);
 
@@ -129,320 +466,1758 @@ int zz_event_delete_queue(
     return 0;
 }
 
-int zz_event_register_event_type_callback(
+int zz_event_set_queue_ready_callback(
     int32_t queue_id,
-    uint32_t event_type,
-    zz_event_callback *callback)
+    zz_event_ready_callback *callback,
+    void *ctx)
 {
     pthread_mutex_lock(&queue_list_mtx);
     event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
-    if (queue_item)
+    if (queue_item == NULL)
     {
-        pthread_mutex_lock(&queue_item->mtx);
-        bool is_new_event_callback = false;
-        zz_event_callback_list_t *event_callback = get_event_callback(&queue_item->queue, event_type);
-        if (event_callback == NULL)
-        {
-            is_new_event_callback = true;
-            event_callback = calloc(1, sizeof(zz_event_callback_list_t));
-            event_callback->event_type = event_type;
-            event_callback->prev = NULL;
-            event_callback->next = NULL;
-        }
-        event_callback->callback = callback;
-
-        if (is_new_event_callback)
-        {
-            // Add the event to the end of the event list
-            zz_event_callback_list_t *curr_item = queue_item->queue.event_callback_list;
-            if (curr_item)
-            {
-                while (curr_item->next)
-                {
-                    curr_item = curr_item->next;
-                }
-                curr_item->next = event_callback;
-                curr_item->next->prev = curr_item;
-            }
-            else
-            {
-                queue_item->queue.event_callback_list = event_callback;
-            }
-        }
-        pthread_mutex_unlock(&queue_item->mtx);
+        pthread_mutex_unlock(&queue_list_mtx);
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
     }
+
+    // The producers call it with their shard locked
+    lock_shards(queue_item);
+    queue_item->ready_callback = callback;
+    queue_item->ready_ctx = ctx;
+    unlock_shards(queue_item);
     pthread_mutex_unlock(&queue_list_mtx);
 
     return 0;
 }
 
-int zz_event_remove_event_type_callback(
+int zz_event_set_queue_urgent_semaphore(
     int32_t queue_id,
-    uint32_t event_type)
+    sem_t *sem)
 {
     pthread_mutex_lock(&queue_list_mtx);
     event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item == NULL)
+    {
+        pthread_mutex_unlock(&queue_list_mtx);
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+    atomic_store(&queue_item->urgent_sem, sem);
+    pthread_mutex_unlock(&queue_list_mtx);
 
-    if (queue_item)
+    return 0;
+}
+
+int zz_event_get_pending_urgent_events(
+    int32_t queue_id,
+    uint32_t *n_events)
+{
+    if (n_events == NULL)
     {
-        pthread_mutex_lock(&queue_item->mtx);
-        remove_callback_from_list(queue_item->queue.event_callback_list, event_type);
-        pthread_mutex_unlock(&queue_item->mtx);
+        return 1;
     }
-    else
+
+    pthread_mutex_lock(&queue_list_mtx);
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item == NULL)
     {
         pthread_mutex_unlock(&queue_list_mtx);
-        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
         return 1;
     }
 
+    // The dequeue position first, the enqueue position can only be larger
+    size_t dequeue_pos = atomic_load(&queue_item->urgent.dequeue_pos);
+    *n_events = (uint32_t)(atomic_load(&queue_item->urgent.enqueue_pos) - dequeue_pos);
     pthread_mutex_unlock(&queue_list_mtx);
 
     return 0;
 }
 
-int zz_event_create_event_in_queue(
+int zz_event_register_event_type_callback(
     int32_t queue_id,
     uint32_t event_type,
-    zz_event_data_type_t data_type,
-    void *data,
-    uint32_t data_size,
-    zz_event_list_t *event)
+    zz_event_callback *callback)
 {
-    pthread_t caller_thread = pthread_self();
-    printf("Adding event to queue <%d> in thread <%" PRIx64 ">.\n", queue_id, (uint64_t)(caller_thread));
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_EXACT;
+    pattern.event_type = event_type;
+    pattern.callback = callback;
 
-    if (event)
+    return register_callback(queue_id, &pattern);
+}
+
+int zz_event_register_event_type_ctx_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx)
+{
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_EXACT;
+    pattern.event_type = event_type;
+    pattern.ctx_callback = callback;
+    pattern.ctx = ctx;
+
+    return register_callback(queue_id, &pattern);
+}
+
+int zz_event_register_event_batch_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_batch_callback *callback,
+    void *ctx)
+{
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_EXACT;
+    pattern.event_type = event_type;
+    pattern.batch_callback = callback;
+    pattern.ctx = ctx;
+
+    return register_callback(queue_id, &pattern);
+}
+
+int zz_event_register_event_range_callback(
+    int32_t queue_id,
+    uint32_t first_event_type,
+    uint32_t last_event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx)
+{
+    if (first_event_type > last_event_type)
     {
-        fprintf(stderr, "event must be null.\n");
+        fprintf(stderr, "Invalid event type range [%u, %u].\n", first_event_type, last_event_type);
         return 1;
     }
 
-    event = calloc(1, sizeof(zz_event_list_t));
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_RANGE;
+    pattern.event_type = first_event_type;
+    pattern.event_type_last = last_event_type;
+    pattern.ctx_callback = callback;
+    pattern.ctx = ctx;
 
-    event->event_type = event_type;
-    event->data_type = data_type;
-    event->data = calloc(1, data_size);
-    memcpy(event->data, data, data_size);
-    event->data_size = data_size;
+    return register_callback(queue_id, &pattern);
+}
 
-    return add_event_to_queue(queue_id, event);
+int zz_event_register_event_mask_callback(
+    int32_t queue_id,
+    uint32_t mask,
+    uint32_t value,
+    zz_event_ctx_callback *callback,
+    void *ctx)
+{
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_MASK;
+    pattern.event_type = value & mask;
+    pattern.event_type_mask = mask;
+    pattern.ctx_callback = callback;
+    pattern.ctx = ctx;
+
+    return register_callback(queue_id, &pattern);
 }
 
-int zz_event_process_events(
+int zz_event_remove_event_type_callback(
     int32_t queue_id,
-    int32_t *n_events)
+    uint32_t event_type)
 {
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_EXACT;
+    pattern.event_type = event_type;
 
-    int32_t event_count = 0;
+    return remove_callback(queue_id, &pattern, false);
+}
+
+int zz_event_remove_event_type_ctx_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx)
+{
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_EXACT;
+    pattern.event_type = event_type;
+    pattern.ctx_callback = callback;
+    pattern.ctx = ctx;
+
+    return remove_callback(queue_id, &pattern, true);
+}
+
+int zz_event_wait_dispatching(
+    int32_t queue_id)
+{
     event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
-    if (queue_item)
+    if (queue_item == NULL)
+    {
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+
+    // The dispatch calls of this thread can not end while it waits
+    uint32_t n_own[2] = {0, 0};
+    for (const dispatch_frame_t *frame = dispatch_frames; frame; frame = frame->prev)
     {
-        zz_event_list_t *curr_event = queue_item->queue.event_list;
-        if (curr_event)
+        if (frame->queue_item == queue_item)
         {
-            pthread_t caller_thread = pthread_self();
-            printf("Processing events from queue <%d> in thread <%" PRIx64 ">.\n", queue_id, (uint64_t)caller_thread);
+            n_own[frame->phase]++;
         }
-        while (curr_event)
-        {
-            zz_event_callback_list_t *callback_item = get_event_callback(&queue_item->queue, curr_event->event_type);
-            if (callback_item)
-            {
-                callback_item->callback(curr_event);
-            }
-
-            pthread_mutex_lock(&queue_item->mtx);
-            zz_event_list_t *next_event = curr_event->next;
-            curr_event->next = NULL;
-            delete_event_list(&curr_event);
-            curr_event = next_event;
-            queue_item->queue.event_list = curr_event;
-            pthread_mutex_unlock(&queue_item->mtx);
+    }
 
-            event_count++;
+    // One waiter flips at a time, otherwise concurrent waiters keep moving
+    // the busy dispatchers back to the phase the others wait to drain. A
+    // thread dispatching the queue can not block on a waiter that may be
+    // waiting for its own dispatch, it goes on without the lock if taken.
+    bool is_dispatching = n_own[0] || n_own[1];
+    bool locked = is_dispatching ? pthread_mutex_trylock(&queue_item->wait_dispatching_mtx) == 0
+                                 : pthread_mutex_lock(&queue_item->wait_dispatching_mtx) == 0;
+
+    // Flip the phase so the dispatch calls starting (or moving on to their
+    // next event) from now are counted apart and wait for the ones of the
+    // previous phase, twice to cover both counters. A call counted after its
+    // counter is seen drained loads the routing table after the change that
+    // came before this wait.
+    for (int round = 0; round < 2; round++)
+    {
+        uint32_t phase = atomic_fetch_xor(&queue_item->dispatch_phase, 1) & 1;
+        while (atomic_load(&queue_item->n_phase_dispatching[phase]) > n_own[phase])
+        {
+            sched_yield();
         }
     }
 
-    if (n_events)
+    if (locked)
     {
-        *n_events = event_count;
+        pthread_mutex_unlock(&queue_item->wait_dispatching_mtx);
     }
 
     return 0;
 }
 
-// Private implementations
-int32_t get_next_free_queue(void)
+int zz_event_remove_event_range_callback(
+    int32_t queue_id,
+    uint32_t first_event_type,
+    uint32_t last_event_type)
 {
-    for (int i = 0; i < ZZ_EVENT_EVENT_MAX_EVENT_QUEUE; i++)
-    {
-        if (event_queues[i].queue.id == ZZ_EVENT_QUEUE_ID_UNSET)
-        {
-            return i;
-        }
-    }
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_RANGE;
+    pattern.event_type = first_event_type;
+    pattern.event_type_last = last_event_type;
 
-    return -1;
+    return remove_callback(queue_id, &pattern, false);
 }
 
-event_queue_item_t *get_queue_item_by_id(int32_t queue_id)
+int zz_event_remove_event_mask_callback(
+    int32_t queue_id,
+    uint32_t mask,
+    uint32_t value)
 {
-    for (int i = 0; i < ZZ_EVENT_EVENT_MAX_EVENT_QUEUE; i++)
-    {
-        if (event_queues[i].queue.id == queue_id)
-        {
-            return &(event_queues[i]);
-        }
-    }
+    zz_event_callback_list_t pattern = {0};
+    pattern.match = ZZ_EVENT_MATCH_MASK;
+    pattern.event_type = value & mask;
+    pattern.event_type_mask = mask;
 
-    return NULL;
+    return remove_callback(queue_id, &pattern, false);
 }
 
-int delete_queue(event_queue_item_t *queue_item)
+int zz_event_create_event_in_queue(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    void *data,
+    uint32_t data_size,
+    zz_event_list_t *event)
 {
-    if (queue_item)
+    if (event)
     {
-        pthread_mutex_lock(&queue_item->mtx);
-        queue_item->queue.id = ZZ_EVENT_QUEUE_ID_UNSET;
-        delete_event_list(&queue_item->queue.event_list);
-        delete_event_callback_list(&queue_item->queue.event_callback_list);
-        queue_item->queue.event_callback_list = NULL;
-        pthread_mutex_unlock(&queue_item->mtx);
+        fprintf(stderr, "event must be null.\n");
+        return 1;
     }
 
-    return 0;
+    if (zz_event_alloc_event(event_type, data_type, data_size, &event))
+    {
+        return 1;
+    }
+
+    if (data)
+    {
+        memcpy(zz_event_data(event), data, data_size);
+    }
+
+    return zz_event_post_event(queue_id, event, NULL);
 }
 
-int delete_event_callback_list(zz_event_callback_list_t **event_callback_list)
+int zz_event_create_events_in_queue(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size,
+    uint32_t n_events)
 {
-    if (event_callback_list)
+    if (n_events == 0)
     {
-        zz_event_callback_list_t *curr_item = *event_callback_list;
+        return 0;
+    }
 
-        if (curr_item)
+    zz_event_list_t **events = calloc(n_events, sizeof(zz_event_list_t *));
+    if (events == NULL)
+    {
+        fprintf(stderr, "Unable to allocate a batch of %u events.\n", n_events);
+        return 1;
+    }
+
+    int err = 0;
+    uint32_t n_created = 0;
+    while (n_created < n_events && !err)
+    {
+        err = zz_event_alloc_event(event_type, data_type, data_size, &events[n_created]);
+        if (!err)
         {
-            do
+            if (data)
             {
-                curr_item->prev = NULL;
-                zz_event_callback_list_t *next_item = curr_item->next;
-                free(curr_item);
-                curr_item = next_item;
-            } while (curr_item);
+                memcpy(zz_event_data(events[n_created]), (const char *)data + (size_t)n_created * data_size, data_size);
+            }
+            n_created++;
         }
+    }
 
-        *event_callback_list = NULL;
+    if (!err)
+    {
+        if (atomic_load_explicit(&verbose, memory_order_relaxed))
+        {
+            pthread_t caller_thread = pthread_self();
+            printf("Adding %u events to queue <%d> in thread <%" PRIx64 ">.\n", n_events, queue_id, (uint64_t)(caller_thread));
+        }
+
+        bool capturing = false;
+        if (zz_event_capture_is_active())
+        {
+            for (uint32_t i = 0; i < n_events; i++)
+            {
+                capturing |= zz_event_capture_record(queue_id, event_type, data_type, zz_event_data(events[i]), data_size) == 0;
+            }
+        }
+
+        err = add_events_to_queue(queue_id, events, n_events, NULL);
+        if (capturing)
+        {
+            zz_event_capture_commit(err == 0);
+        }
+    }
+
+    if (err)
+    {
+        for (uint32_t i = 0; i < n_created; i++)
+        {
+            delete_event_list(&events[i]);
+        }
+    }
+    free(events);
+
+    return err;
+}
+
+int zz_event_alloc_event(
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    uint32_t data_size,
+    zz_event_list_t **event)
+{
+    if (event == NULL)
+    {
+        fprintf(stderr, "event must not be null.\n");
+        return 1;
+    }
+
+    // The payload is placed right after the header, so a single allocation
+    // holds the whole event and the payload keeps the max_align_t alignment
+    zz_event_list_t *new_event = calloc(1, ZZ_EVENT_DATA_OFFSET + data_size);
+    if (new_event == NULL)
+    {
+        fprintf(stderr, "Unable to allocate an event of %u bytes.\n", data_size);
+        return 1;
     }
 
+    new_event->event_type = event_type;
+    new_event->data_type = (uint16_t)data_type;
+    new_event->data_size = data_size;
+    *event = new_event;
+
     return 0;
 }
 
-int delete_event_list(zz_event_list_t **event_list)
+int zz_event_post_event(
+    int32_t queue_id,
+    zz_event_list_t *event,
+    uint32_t *uuid)
 {
-    if (event_list)
+    if (atomic_load_explicit(&verbose, memory_order_relaxed))
     {
-        zz_event_list_t *curr_item = *event_list;
+        pthread_t caller_thread = pthread_self();
+        printf("Adding event to queue <%d> in thread <%" PRIx64 ">.\n", queue_id, (uint64_t)(caller_thread));
+    }
 
-        if (curr_item)
+    // Staged before adding it, the consumer may release the event right after,
+    // and recorded only if the queue accepts it
+    bool capturing = zz_event_capture_is_active() &&
+                     zz_event_capture_record(queue_id, event->event_type, (zz_event_data_type_t)event->data_type,
+                                             zz_event_data(event), event->data_size) == 0;
+
+    int err = add_events_to_queue(queue_id, &event, 1, uuid);
+    if (capturing)
+    {
+        zz_event_capture_commit(err == 0);
+    }
+    if (err)
+    {
+        delete_event_list(&event);
+    }
+
+    return err;
+}
+
+int zz_event_free_event(
+    zz_event_list_t *event)
+{
+    return delete_event_list(&event);
+}
+
+int zz_event_post_urgent_event(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size)
+{
+    // Called from signal handlers: no allocation, no lock and no stdio here
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item == NULL || data_size > ZZ_EVENT_URGENT_MAX_DATA_SIZE || (data == NULL && data_size))
+    {
+        return 1;
+    }
+
+    urgent_lane_t *lane = &queue_item->urgent;
+    size_t pos = atomic_load_explicit(&lane->enqueue_pos, memory_order_relaxed);
+    urgent_slot_t *slot = NULL;
+    while (true)
+    {
+        slot = &lane->slots[pos % ZZ_EVENT_URGENT_CAPACITY];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
         {
-            do
+            // Sequentially consistent, ordered with the parked flag checked
+            // by wake_consumer below
+            if (atomic_compare_exchange_weak(&lane->enqueue_pos, &pos, pos + 1))
             {
-                curr_item->prev = NULL;
-                zz_event_list_t *next_item = curr_item->next;
-                free(curr_item->data);
-                curr_item->data_size = 0;
-                curr_item->data_type = ZZ_EVENT_DATA_TYPE_UNDEFINED;
-                curr_item->event_type = 0;
-                curr_item->uuid = 0;
-                free(curr_item);
-                curr_item = next_item;
-            } while (curr_item);
+                break;
+            }
         }
-        *event_list = NULL;
+        else if (diff < 0)
+        {
+            // The lane is full, the consumer has not freed this slot yet
+            return 1;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&lane->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->event_type = event_type;
+    slot->data_type = data_type;
+    slot->data_size = data_size;
+    // The trace can not be written here, the consumer records the post
+    slot->post_ns = zz_event_trace_is_active() ? getMonotonicNs() : 0;
+    if (data_size)
+    {
+        memcpy(slot->data, data, data_size);
+    }
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    wake_consumer(queue_item);
+    sem_t *urgent_sem = atomic_load(&queue_item->urgent_sem);
+    if (urgent_sem)
+    {
+        sem_post(urgent_sem);
     }
 
     return 0;
 }
 
-int remove_callback_from_list(zz_event_callback_list_t *event_list, uint32_t event_type)
+int zz_event_cancel(
+    int32_t queue_id,
+    uint32_t uuid)
 {
-    if (event_list)
+    zz_event_list_t *cancelled = NULL;
+    bool found = false;
+
+    // Like the producers, only the shard of the event is locked
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    event_shard_t *shard = queue_item ? &queue_item->shards[UUID_SHARD(uuid)] : NULL;
+    if (shard)
     {
-        zz_event_callback_list_t *curr_item = event_list;
-        do
+        pthread_mutex_lock(&shard->mtx);
+        // The queue may have been deleted before the lock was taken
+        if (queue_item->queue.id != queue_id)
         {
-            zz_event_callback_list_t *next_item = curr_item->next;
-            if (curr_item->event_type == event_type)
-            {
-                if (curr_item->prev)
-                {
-                    curr_item->prev->next = curr_item->next;
-                    curr_item->prev = NULL;
-                }
-                if (curr_item->next)
-                {
-                    curr_item->next->prev = curr_item->prev;
-                    curr_item->next = NULL;
-                }
-                delete_event_callback_list(&curr_item);
-            }
-            curr_item = next_item;
-        } while (curr_item);
+            pthread_mutex_unlock(&shard->mtx);
+            shard = NULL;
+        }
+    }
+    if (shard == NULL)
+    {
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
     }
 
-    return 0;
+    int64_t slot = uuid_index_find(shard, uuid);
+    if (slot >= 0)
+    {
+        // The list is singly linked, the event is only marked here and
+        // unlinked when the consumer reaches it
+        cancel_event(shard, shard->uuid_index[slot]);
+        found = true;
+
+        // Unlink them all once they outnumber the pending events, so each
+        // cancellation costs a constant amortized time
+        if (shard->n_cancelled > atomic_load_explicit(&shard->n_events, memory_order_relaxed))
+        {
+            sweep_cancelled_events(shard, &cancelled);
+        }
+    }
+    pthread_mutex_unlock(&shard->mtx);
+
+    // Release out of the lock, the data destructor may take a while
+    delete_event_list(&cancelled);
+
+    // Not found if already dispatched or never posted to this queue
+    return found ? 0 : 1;
 }
 
-zz_event_callback_list_t *get_event_callback(zz_event_queue_t *queue, uint32_t event_type)
+int zz_event_cancel_by_type(
+    int32_t queue_id,
+    uint32_t event_type,
+    uint32_t *n_cancelled)
 {
-    zz_event_callback_list_t *ret = NULL;
-    zz_event_callback_list_t *curr_item = queue->event_callback_list;
-    while (curr_item)
+    zz_event_list_t *cancelled = NULL;
+    uint32_t count = 0;
+
+    // One shard locked at a time, the producers of the other shards go on
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    bool exists = queue_item != NULL;
+    for (uint32_t i = 0; exists && i < EVENT_SHARDS; i++)
     {
-        if (curr_item->event_type == event_type)
+        event_shard_t *shard = &queue_item->shards[i];
+        pthread_mutex_lock(&shard->mtx);
+        // The queue may have been deleted in the meantime, with its events
+        if (queue_item->queue.id != queue_id)
         {
-            ret = curr_item;
+            pthread_mutex_unlock(&shard->mtx);
+            exists = false;
             break;
         }
-        curr_item = curr_item->next;
+        for (zz_event_list_t *curr_event = shard->event_list; curr_event; curr_event = curr_event->next)
+        {
+            if (!(curr_event->flags & EVENT_FLAG_CANCELLED) && curr_event->event_type == event_type)
+            {
+                cancel_event(shard, curr_event);
+                count++;
+            }
+        }
+        if (shard->n_cancelled)
+        {
+            sweep_cancelled_events(shard, &cancelled);
+        }
+        pthread_mutex_unlock(&shard->mtx);
     }
 
-    return ret;
+    delete_event_list(&cancelled);
+
+    if (!exists)
+    {
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+
+    if (n_cancelled)
+    {
+        *n_cancelled = count;
+    }
+
+    return 0;
 }
 
-int add_event_to_queue(
+int zz_event_process_events(
     int32_t queue_id,
-    zz_event_list_t *event)
+    int32_t *n_events)
 {
-    pthread_mutex_lock(&queue_list_mtx);
+    return zz_event_process_events_budget(queue_id, 0, 0, n_events, NULL);
+}
+
+int zz_event_process_events_budget(
+    int32_t queue_id,
+    uint32_t max_events,
+    uint64_t max_time_us,
+    int32_t *n_events,
+    uint32_t *n_remaining)
+{
+    int32_t event_count = 0;
+    uint32_t remaining = 0;
     event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
     if (queue_item)
     {
-        pthread_mutex_lock(&queue_item->mtx);
-        if (queue_item->queue.event_list == NULL)
+        uint64_t deadline_ns = max_time_us ? getMonotonicNs() + max_time_us * 1000 : 0;
+
+        zz_event_list_t *curr_event = NULL;
+        if (atomic_load_explicit(&verbose, memory_order_relaxed) && queue_pending(queue_item))
         {
-            queue_item->queue.event_list = event;
+            pthread_t caller_thread = pthread_self();
+            printf("Processing events from queue <%d> in thread <%" PRIx64 ">.\n", queue_id, (uint64_t)caller_thread);
         }
-        else
+        // Routing tables replaced from now on are not released until the
+        // counter drops back to 0, so dispatch can use them without locking
+        atomic_fetch_add(&queue_item->n_dispatching, 1);
+        dispatch_frame_t frame;
+        frame.queue_item = queue_item;
+        frame.phase = atomic_load(&queue_item->dispatch_phase) & 1;
+        frame.prev = dispatch_frames;
+        atomic_fetch_add(&queue_item->n_phase_dispatching[frame.phase], 1);
+        dispatch_frames = &frame;
+
+        bool tracing = zz_event_trace_is_active();
+        // Consecutive events of a type with a batch callback are held here
+        // and dispatched together
+        zz_event_list_t *batch[ZZ_EVENT_BATCH_MAX_EVENTS];
+        uint32_t n_batch = 0;
+        const zz_event_route_t *batch_route = NULL;
+        urgent_event_t urgent_event;
+        while ((max_events == 0 || (uint32_t)event_count < max_events) &&
+               (curr_event = pop_event(queue_item, n_batch ? batch[n_batch - 1] : NULL, &urgent_event)))
+        {
+            event_count++;
+
+            // Urgent events live in urgent_event, reused by the next one, so
+            // they are never held in a batch
+            bool is_urgent = curr_event->flags & EVENT_FLAG_URGENT;
+            const zz_event_route_table_t *route_table = atomic_load(&queue_item->route_table);
+            const zz_event_route_t *route = NULL;
+            if (!is_urgent && route_table && route_table->n_batch_routes)
+            {
+                route = zz_event_route_find(route_table, curr_event->event_type);
+                route = zz_event_route_is_batch(route) ? route : NULL;
+            }
+
+            // Any other event ends the batch, so the dispatch order is kept. A
+            // wildcard route matches several types, the batch keeps only one
+            if (n_batch && (route != batch_route || n_batch == ZZ_EVENT_BATCH_MAX_EVENTS ||
+                            curr_event->event_type != batch[0]->event_type ||
+                            curr_event->data_type != batch[0]->data_type ||
+                            curr_event->data_size != batch[0]->data_size))
+            {
+                dispatch_batch(queue_id, batch_route, batch, n_batch, tracing);
+                n_batch = 0;
+            }
+
+            if (route)
+            {
+                batch_route = route;
+                batch[n_batch++] = curr_event;
+            }
+            else
+            {
+                // Recorded here rather than on pop, once the batch before is
+                // dispatched, so the slices of the trace do not nest
+                uint64_t trace_id = is_urgent ? urgent_event.trace_id : curr_event->uuid;
+                if (tracing)
+                {
+                    zz_event_trace_record(ZZ_EVENT_TRACE_DEQUEUE, queue_id, curr_event->event_type, trace_id);
+                }
+                dispatch_event(queue_item, curr_event);
+                if (tracing)
+                {
+                    zz_event_trace_record(ZZ_EVENT_TRACE_DONE, queue_id, curr_event->event_type, trace_id);
+                }
+                if (!is_urgent)
+                {
+                    delete_event_list(&curr_event);
+                }
+            }
+
+            if (deadline_ns && getMonotonicNs() >= deadline_ns)
+            {
+                break;
+            }
+            if (n_batch == 0)
+            {
+                // No route is held between events, a busy queue does not keep
+                // zz_event_wait_dispatching waiting
+                refresh_dispatch_phase(&frame);
+            }
+        }
+        if (n_batch)
+        {
+            dispatch_batch(queue_id, batch_route, batch, n_batch, tracing);
+        }
+
+        dispatch_frames = frame.prev;
+        atomic_fetch_sub(&queue_item->n_phase_dispatching[frame.phase], 1);
+        if (atomic_fetch_sub(&queue_item->n_dispatching, 1) == 1 &&
+            atomic_load(&queue_item->has_retired_routes))
         {
-            zz_event_list_t *curr_item = queue_item->queue.event_list;
-            while (curr_item->next)
+            pthread_mutex_lock(&queue_item->mtx);
+            if (atomic_load(&queue_item->n_dispatching) == 0)
             {
-                curr_item = curr_item->next;
+                free_retired_routes(queue_item);
             }
-            event->prev = curr_item;
-            curr_item->next = event;
+            pthread_mutex_unlock(&queue_item->mtx);
         }
-        pthread_mutex_unlock(&queue_item->mtx);
+
+        remaining = queue_pending(queue_item);
     }
-    else
+
+    if (n_events)
+    {
+        *n_events = event_count;
+    }
+    if (n_remaining)
+    {
+        *n_remaining = remaining;
+    }
+
+    return queue_item ? 0 : 1;
+}
+
+int zz_event_process_queues(
+    const int32_t *queue_ids,
+    uint32_t n_queues,
+    uint32_t max_events_per_queue,
+    uint64_t max_time_us,
+    int32_t *n_events,
+    uint32_t *n_remaining)
+{
+    uint64_t start_ns = getMonotonicNs();
+    uint64_t elapsed_us = 0;
+    int32_t event_count = 0;
+    uint32_t remaining = 0;
+    bool has_events = true;
+
+    // Each pass gives every queue at most max_events_per_queue events, so a
+    // busy queue can not starve the others
+    while (has_events && (max_time_us == 0 || elapsed_us < max_time_us))
+    {
+        has_events = false;
+        remaining = 0;
+        for (uint32_t i = 0; i < n_queues; i++)
+        {
+            int32_t queue_events = 0;
+            uint32_t queue_remaining = 0;
+            uint64_t time_left_us = 0;
+            if (max_time_us)
+            {
+                elapsed_us = (getMonotonicNs() - start_ns) / 1000;
+                if (elapsed_us >= max_time_us)
+                {
+                    // Out of time, the rest of the queues are still pending
+                    has_events = false;
+                    break;
+                }
+                time_left_us = max_time_us - elapsed_us;
+            }
+
+            zz_event_process_events_budget(
+                queue_ids[i], max_events_per_queue, time_left_us, &queue_events, &queue_remaining);
+            event_count += queue_events;
+            remaining += queue_remaining;
+            has_events = has_events || (queue_remaining > 0);
+        }
+
+        if (max_events_per_queue == 0)
+        {
+            // Unlimited passes drain every queue in a single pass
+            break;
+        }
+    }
+
+    if (n_remaining)
+    {
+        // Count again, the queues skipped by the time budget were not counted
+        remaining = 0;
+        for (uint32_t i = 0; i < n_queues; i++)
+        {
+            event_queue_item_t *queue_item = get_queue_item_by_id(queue_ids[i]);
+            if (queue_item)
+            {
+                remaining += queue_pending(queue_item);
+            }
+        }
+        *n_remaining = remaining;
+    }
+
+    if (n_events)
+    {
+        *n_events = event_count;
+    }
+
+    return 0;
+}
+
+int zz_event_set_wait_strategy(
+    int32_t queue_id,
+    const zz_event_wait_strategy_t *strategy)
+{
+    if (strategy == NULL)
+    {
+        fprintf(stderr, "strategy must not be null.\n");
+        return 1;
+    }
+
+    pthread_mutex_lock(&queue_list_mtx);
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item == NULL)
     {
         pthread_mutex_unlock(&queue_list_mtx);
         fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
         return 1;
     }
 
+    pthread_mutex_lock(&queue_item->mtx);
+    queue_item->wait_strategy = *strategy;
+    pthread_mutex_unlock(&queue_item->mtx);
     pthread_mutex_unlock(&queue_list_mtx);
 
     return 0;
 }
+
+int zz_event_wait_events(
+    int32_t queue_id,
+    uint64_t max_wait_us,
+    uint32_t *n_pending)
+{
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item == NULL)
+    {
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+
+    pthread_mutex_lock(&queue_item->mtx);
+    zz_event_wait_strategy_t strategy = queue_item->wait_strategy;
+    pthread_mutex_unlock(&queue_item->mtx);
+
+    uint64_t deadline_ns = max_wait_us ? getMonotonicNs() + max_wait_us * 1000 : 0;
+    uint32_t pending = 0;
+    bool timed_out = false;
+
+    // Spin: no system call, the consumer reacts within nanoseconds
+    for (uint32_t i = 0; (pending = queue_pending(queue_item)) == 0; i++)
+    {
+        if (strategy.mode != ZZ_EVENT_WAIT_SPIN && i >= strategy.spin_iterations)
+        {
+            break;
+        }
+        // Reading the clock costs more than a pause, check it from time to time
+        if (deadline_ns && (i % 64) == 63 && getMonotonicNs() >= deadline_ns)
+        {
+            timed_out = true;
+            break;
+        }
+        CPU_PAUSE();
+    }
+
+    // Yield: lets other threads use the core while still polling
+    if (pending == 0 && !timed_out && strategy.mode != ZZ_EVENT_WAIT_SPIN)
+    {
+        for (uint32_t i = 0; (pending = queue_pending(queue_item)) == 0; i++)
+        {
+            if (strategy.mode == ZZ_EVENT_WAIT_PARK && i >= strategy.yield_iterations)
+            {
+                break;
+            }
+            if (deadline_ns && getMonotonicNs() >= deadline_ns)
+            {
+                timed_out = true;
+                break;
+            }
+            sched_yield();
+        }
+    }
+
+    // Park: sleep until a producer adds an event
+    if (pending == 0 && !timed_out && strategy.mode == ZZ_EVENT_WAIT_PARK)
+    {
+        pending = park_consumer(queue_item, deadline_ns);
+    }
+
+    if (n_pending)
+    {
+        *n_pending = pending;
+    }
+
+    return 0;
+}
+
+// Private implementations
+int32_t get_next_free_queue(int32_t queue_id)
+{
+    // Start at the slot of the id, so the lookups usually find the queue in
+    // the first slot they check
+    for (int i = 0; i < ZZ_EVENT_EVENT_MAX_EVENT_QUEUE; i++)
+    {
+        int32_t slot = (int32_t)(((uint32_t)queue_id + i) % ZZ_EVENT_EVENT_MAX_EVENT_QUEUE);
+        if (event_queues[slot].queue.id == ZZ_EVENT_QUEUE_ID_UNSET)
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+event_queue_item_t *get_queue_item_by_id(int32_t queue_id)
+{
+    if (queue_id < 0)
+    {
+        return NULL;
+    }
+
+    int max_probe = atomic_load_explicit(&max_queue_probe, memory_order_relaxed);
+    for (int i = 0; i <= max_probe; i++)
+    {
+        int32_t slot = (int32_t)(((uint32_t)queue_id + i) % ZZ_EVENT_EVENT_MAX_EVENT_QUEUE);
+        if (event_queues[slot].queue.id == queue_id)
+        {
+            return &(event_queues[slot]);
+        }
+    }
+
+    return NULL;
+}
+
+int delete_queue(event_queue_item_t *queue_item)
+{
+    if (queue_item)
+    {
+        pthread_mutex_lock(&queue_item->mtx);
+        lock_shards(queue_item);
+        queue_item->queue.id = ZZ_EVENT_QUEUE_ID_UNSET;
+        for (uint32_t i = 0; i < EVENT_SHARDS; i++)
+        {
+            event_shard_t *shard = &queue_item->shards[i];
+            delete_event_list(&shard->event_list);
+            shard->event_list_tail = NULL;
+            atomic_store(&shard->n_events, 0);
+            shard->n_cancelled = 0;
+            shard->next_seq = 1;
+            free(shard->uuid_index);
+            shard->uuid_index = NULL;
+            shard->uuid_index_mask = 0;
+        }
+        reset_urgent_lane(&queue_item->urgent);
+        queue_item->ready_callback = NULL;
+        queue_item->ready_ctx = NULL;
+        atomic_store(&queue_item->urgent_sem, NULL);
+        unlock_shards(queue_item);
+        delete_event_callback_list(&queue_item->queue.event_callback_list);
+        queue_item->queue.event_callback_list = NULL;
+        // A thread may still be dispatching with the routing table, retire it
+        // like any replaced table (no callbacks builds no table, so this can
+        // not fail)
+        rebuild_routes(queue_item);
+        queue_item->wait_strategy = default_wait_strategy;
+        pthread_mutex_unlock(&queue_item->mtx);
+    }
+
+    return 0;
+}
+
+int delete_event_callback_list(zz_event_callback_list_t **event_callback_list)
+{
+    if (event_callback_list)
+    {
+        zz_event_callback_list_t *curr_item = *event_callback_list;
+
+        if (curr_item)
+        {
+            do
+            {
+                curr_item->prev = NULL;
+                zz_event_callback_list_t *next_item = curr_item->next;
+                free(curr_item);
+                curr_item = next_item;
+            } while (curr_item);
+        }
+
+        *event_callback_list = NULL;
+    }
+
+    return 0;
+}
+
+int delete_event_list(zz_event_list_t **event_list)
+{
+    if (event_list)
+    {
+        zz_event_list_t *curr_item = *event_list;
+
+        if (curr_item)
+        {
+            do
+            {
+                zz_event_list_t *next_item = curr_item->next;
+                if (curr_item->data_destructor)
+                {
+                    curr_item->data_destructor(zz_event_data(curr_item));
+                    curr_item->data_destructor = NULL;
+                }
+                curr_item->data_size = 0;
+                curr_item->data_type = ZZ_EVENT_DATA_TYPE_UNDEFINED;
+                curr_item->event_type = 0;
+                curr_item->uuid = 0;
+                free(curr_item);
+                curr_item = next_item;
+            } while (curr_item);
+        }
+        *event_list = NULL;
+    }
+
+    return 0;
+}
+
+int remove_callback_from_list(zz_event_queue_t *queue, const zz_event_callback_list_t *pattern)
+{
+    zz_event_callback_list_t *curr_item = get_event_callback(queue, pattern);
+    if (curr_item)
+    {
+        if (curr_item->prev)
+        {
+            curr_item->prev->next = curr_item->next;
+        }
+        else
+        {
+            queue->event_callback_list = curr_item->next;
+        }
+        if (curr_item->next)
+        {
+            curr_item->next->prev = curr_item->prev;
+        }
+        curr_item->prev = NULL;
+        curr_item->next = NULL;
+        delete_event_callback_list(&curr_item);
+    }
+
+    return 0;
+}
+
+int register_callback(
+    int32_t queue_id,
+    const zz_event_callback_list_t *pattern)
+{
+    pthread_mutex_lock(&queue_list_mtx);
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    if (queue_item)
+    {
+        pthread_mutex_lock(&queue_item->mtx);
+        bool is_new_event_callback = false;
+        zz_event_callback_list_t *event_callback = get_event_callback(&queue_item->queue, pattern);
+        if (event_callback == NULL)
+        {
+            is_new_event_callback = true;
+            event_callback = calloc(1, sizeof(zz_event_callback_list_t));
+            event_callback->match = pattern->match;
+            event_callback->event_type = pattern->event_type;
+            event_callback->event_type_last = pattern->event_type_last;
+            event_callback->event_type_mask = pattern->event_type_mask;
+            event_callback->prev = NULL;
+            event_callback->next = NULL;
+        }
+        event_callback->callback = pattern->callback;
+        event_callback->ctx_callback = pattern->ctx_callback;
+        event_callback->batch_callback = pattern->batch_callback;
+        event_callback->ctx = pattern->ctx;
+
+        if (is_new_event_callback)
+        {
+            // Add the event to the end of the event list
+            zz_event_callback_list_t *curr_item = queue_item->queue.event_callback_list;
+            if (curr_item)
+            {
+                while (curr_item->next)
+                {
+                    curr_item = curr_item->next;
+                }
+                curr_item->next = event_callback;
+                curr_item->next->prev = curr_item;
+            }
+            else
+            {
+                queue_item->queue.event_callback_list = event_callback;
+            }
+        }
+        rebuild_routes(queue_item);
+        pthread_mutex_unlock(&queue_item->mtx);
+    }
+    else
+    {
+        pthread_mutex_unlock(&queue_list_mtx);
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+    pthread_mutex_unlock(&queue_list_mtx);
+
+    return 0;
+}
+
+int remove_callback(
+    int32_t queue_id,
+    const zz_event_callback_list_t *pattern,
+    bool match_ctx)
+{
+    pthread_mutex_lock(&queue_list_mtx);
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+
+    if (queue_item)
+    {
+        pthread_mutex_lock(&queue_item->mtx);
+        const zz_event_callback_list_t *event_callback = get_event_callback(&queue_item->queue, pattern);
+        // With match_ctx, a callback registered since by someone else stays
+        if (event_callback && (!match_ctx || (event_callback->ctx_callback == pattern->ctx_callback &&
+                                              event_callback->ctx == pattern->ctx)))
+        {
+            remove_callback_from_list(&queue_item->queue, pattern);
+            rebuild_routes(queue_item);
+        }
+        pthread_mutex_unlock(&queue_item->mtx);
+    }
+    else
+    {
+        pthread_mutex_unlock(&queue_list_mtx);
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+
+    pthread_mutex_unlock(&queue_list_mtx);
+
+    return 0;
+}
+
+zz_event_callback_list_t *get_event_callback(zz_event_queue_t *queue, const zz_event_callback_list_t *pattern)
+{
+    zz_event_callback_list_t *ret = NULL;
+    zz_event_callback_list_t *curr_item = queue->event_callback_list;
+    while (curr_item)
+    {
+        if (curr_item->match == pattern->match &&
+            curr_item->event_type == pattern->event_type &&
+            curr_item->event_type_last == pattern->event_type_last &&
+            curr_item->event_type_mask == pattern->event_type_mask)
+        {
+            ret = curr_item;
+            break;
+        }
+        curr_item = curr_item->next;
+    }
+
+    return ret;
+}
+
+int rebuild_routes(event_queue_item_t *queue_item)
+{
+    zz_event_route_table_t *route_table = NULL;
+    if (zz_event_route_build(queue_item->queue.event_callback_list, &route_table))
+    {
+        // Keep dispatching with the previous routes
+        return 1;
+    }
+
+    // Publish the new table. Threads dispatching right now may still be
+    // using the old one, so it is released once none of them is dispatching.
+    // The counter is checked after the exchange: a thread that starts
+    // dispatching later is guaranteed to load the new table.
+    zz_event_route_table_t *old_route_table = atomic_exchange(&queue_item->route_table, route_table);
+    if (old_route_table)
+    {
+        old_route_table->retired_next = queue_item->retired_route_tables;
+        queue_item->retired_route_tables = old_route_table;
+        atomic_store(&queue_item->has_retired_routes, true);
+    }
+    if (atomic_load(&queue_item->n_dispatching) == 0)
+    {
+        free_retired_routes(queue_item);
+    }
+
+    return 0;
+}
+
+void free_retired_routes(event_queue_item_t *queue_item)
+{
+    zz_event_route_table_t *route_table = queue_item->retired_route_tables;
+    while (route_table)
+    {
+        zz_event_route_table_t *next_route_table = route_table->retired_next;
+        zz_event_route_free(route_table);
+        route_table = next_route_table;
+    }
+    queue_item->retired_route_tables = NULL;
+    atomic_store(&queue_item->has_retired_routes, false);
+}
+
+int add_events_to_queue(
+    int32_t queue_id,
+    zz_event_list_t *const *events,
+    uint32_t n_events,
+    uint32_t *uuid)
+{
+    // No global lock: the producers only share the shard lock with the other
+    // producers of the same shard and with the consumer
+    event_queue_item_t *queue_item = get_queue_item_by_id(queue_id);
+    event_shard_t *shard = queue_item ? &queue_item->shards[get_producer_shard()] : NULL;
+    if (shard)
+    {
+        pthread_mutex_lock(&shard->mtx);
+        // The queue may have been deleted before the lock was taken
+        if (queue_item->queue.id != queue_id)
+        {
+            pthread_mutex_unlock(&shard->mtx);
+            shard = NULL;
+        }
+    }
+    if (shard == NULL)
+    {
+        fprintf(stderr, "Event queue <%d> not found.\n", queue_id);
+        return 1;
+    }
+
+    bool tracing = zz_event_trace_is_active();
+    zz_event_list_t *prev_tail = shard->event_list_tail;
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        zz_event_list_t *event = events[i];
+        event->uuid = (shard->next_seq << ZZ_EVENT_QUEUE_SHARD_BITS) | (uint32_t)(shard - queue_item->shards);
+        if (uuid_index_insert(shard, event))
+        {
+            // All or nothing: take back the events of the batch already added,
+            // no consumer can see them before the lock is released
+            for (uint32_t j = 0; j < i; j++)
+            {
+                retire_event(shard, events[j]);
+                events[j]->next = NULL;
+            }
+            if (prev_tail)
+            {
+                prev_tail->next = NULL;
+            }
+            else
+            {
+                shard->event_list = NULL;
+            }
+            shard->event_list_tail = prev_tail;
+            pthread_mutex_unlock(&shard->mtx);
+            fprintf(stderr, "Unable to index the event in queue <%d>.\n", queue_id);
+            return 1;
+        }
+
+        if (tracing)
+        {
+            zz_event_trace_record(ZZ_EVENT_TRACE_ENQUEUE, queue_id, event->event_type, event->uuid);
+        }
+
+        // 0 is never used as sequence number, so the uuid is never 0
+        shard->next_seq = (shard->next_seq + 1) & (UINT32_MAX >> ZZ_EVENT_QUEUE_SHARD_BITS);
+        if (shard->next_seq == 0)
+        {
+            shard->next_seq = 1;
+        }
+
+        link_event(shard, event);
+    }
+
+    if (queue_item->ready_callback)
+    {
+        queue_item->ready_callback(queue_id, queue_item->ready_ctx);
+    }
+
+    // The events can be released as soon as the lock is released
+    if (uuid && n_events)
+    {
+        *uuid = events[0]->uuid;
+    }
+    pthread_mutex_unlock(&shard->mtx);
+
+    wake_consumer(queue_item);
+
+    return 0;
+}
+
+void link_event(event_shard_t *shard, zz_event_list_t *event)
+{
+    if (shard->event_list_tail == NULL)
+    {
+        shard->event_list = event;
+    }
+    else
+    {
+        shard->event_list_tail->next = event;
+    }
+    shard->event_list_tail = event;
+    // Sequentially consistent, ordered with the parked flag checked by
+    // wake_consumer and with the check of a consumer going to sleep
+    atomic_fetch_add(&shard->n_events, 1);
+}
+
+uint32_t get_producer_shard(void)
+{
+    if (producer_shard == UINT32_MAX)
+    {
+        producer_shard = atomic_fetch_add_explicit(&next_producer_shard, 1, memory_order_relaxed) % EVENT_SHARDS;
+    }
+
+    return producer_shard;
+}
+
+void lock_shards(event_queue_item_t *queue_item)
+{
+    for (uint32_t i = 0; i < EVENT_SHARDS; i++)
+    {
+        pthread_mutex_lock(&queue_item->shards[i].mtx);
+    }
+}
+
+void unlock_shards(event_queue_item_t *queue_item)
+{
+    for (uint32_t i = EVENT_SHARDS; i > 0; i--)
+    {
+        pthread_mutex_unlock(&queue_item->shards[i - 1].mtx);
+    }
+}
+
+uint32_t queue_pending(event_queue_item_t *queue_item)
+{
+    // The dequeue position first, the enqueue position can only be larger
+    size_t dequeue_pos = atomic_load(&queue_item->urgent.dequeue_pos);
+    uint32_t pending = (uint32_t)(atomic_load(&queue_item->urgent.enqueue_pos) - dequeue_pos);
+    for (uint32_t i = 0; i < EVENT_SHARDS; i++)
+    {
+        pending += atomic_load(&queue_item->shards[i].n_events);
+    }
+
+    return pending;
+}
+
+void refresh_dispatch_phase(dispatch_frame_t *frame)
+{
+    event_queue_item_t *queue_item = frame->queue_item;
+    uint32_t phase = atomic_load_explicit(&queue_item->dispatch_phase, memory_order_relaxed) & 1;
+    if (phase != frame->phase)
+    {
+        atomic_fetch_add(&queue_item->n_phase_dispatching[phase], 1);
+        atomic_fetch_sub(&queue_item->n_phase_dispatching[frame->phase], 1);
+        frame->phase = phase;
+    }
+}
+
+zz_event_list_t *pop_event(
+    event_queue_item_t *queue_item,
+    const zz_event_list_t *batch_event,
+    urgent_event_t *urgent_event)
+{
+    zz_event_list_t *event = pop_urgent_event(queue_item, urgent_event);
+    if (event)
+    {
+        return event;
+    }
+
+    // While a batch is being staged keep taking the events of its shard, so
+    // the events posted together are dispatched together
+    if (batch_event && batch_event->uuid)
+    {
+        event = pop_shard_event(&queue_item->shards[UUID_SHARD(batch_event->uuid)]);
+        if (event)
+        {
+            return event;
+        }
+    }
+
+    // Start every pop at the next shard, so the events of all the producers
+    // are interleaved and a busy producer can not delay the others
+    uint32_t first_shard = atomic_fetch_add_explicit(&queue_item->drain_shard, 1, memory_order_relaxed);
+    for (uint32_t i = 0; i < EVENT_SHARDS; i++)
+    {
+        event = pop_shard_event(&queue_item->shards[(first_shard + i) % EVENT_SHARDS]);
+        if (event)
+        {
+            return event;
+        }
+    }
+
+    return NULL;
+}
+
+zz_event_list_t *pop_shard_event(event_shard_t *shard)
+{
+    if (atomic_load_explicit(&shard->n_events, memory_order_relaxed) == 0)
+    {
+        return NULL;
+    }
+
+    zz_event_list_t *cancelled = NULL;
+    pthread_mutex_lock(&shard->mtx);
+    zz_event_list_t *event = shift_event(shard);
+    while (event && (event->flags & EVENT_FLAG_CANCELLED))
+    {
+        shard->n_cancelled--;
+        event->next = cancelled;
+        cancelled = event;
+        event = shift_event(shard);
+    }
+    if (event)
+    {
+        retire_event(shard, event);
+        if (atomic_load_explicit(&shard->n_events, memory_order_relaxed) == 0 && shard->n_cancelled)
+        {
+            // Only cancelled events are left, no pop would reach them
+            sweep_cancelled_events(shard, &cancelled);
+        }
+    }
+    pthread_mutex_unlock(&shard->mtx);
+
+    delete_event_list(&cancelled);
+
+    return event;
+}
+
+zz_event_list_t *pop_urgent_event(event_queue_item_t *queue_item, urgent_event_t *urgent_event)
+{
+    urgent_lane_t *lane = &queue_item->urgent;
+    size_t pos = atomic_load_explicit(&lane->dequeue_pos, memory_order_relaxed);
+    urgent_slot_t *slot = NULL;
+    while (true)
+    {
+        slot = &lane->slots[pos % ZZ_EVENT_URGENT_CAPACITY];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak(&lane->dequeue_pos, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Empty, or the next slot is claimed but not written yet
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&lane->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    // The dispatch needs a regular event, built in the storage of the caller
+    zz_event_list_t *event = (zz_event_list_t *)urgent_event->bytes;
+    memset(event, 0, sizeof(zz_event_list_t));
+    event->event_type = slot->event_type;
+    event->data_type = (uint16_t)slot->data_type;
+    event->data_size = slot->data_size;
+    event->flags = EVENT_FLAG_URGENT;
+    memcpy(zz_event_data(event), slot->data, slot->data_size);
+    urgent_event->trace_id = ZZ_EVENT_TRACE_URGENT_ID | (uint32_t)pos;
+    if (slot->post_ns && zz_event_trace_is_active())
+    {
+        zz_event_trace_record_at(ZZ_EVENT_TRACE_ENQUEUE, queue_item->queue.id, event->event_type,
+                                 urgent_event->trace_id, slot->post_ns);
+    }
+    // Free the slot for the producers of the next round of the ring
+    atomic_store_explicit(&slot->seq, pos + ZZ_EVENT_URGENT_CAPACITY, memory_order_release);
+
+    return event;
+}
+
+void reset_urgent_lane(urgent_lane_t *lane)
+{
+    atomic_store(&lane->enqueue_pos, 0);
+    atomic_store(&lane->dequeue_pos, 0);
+    for (size_t i = 0; i < ZZ_EVENT_URGENT_CAPACITY; i++)
+    {
+        atomic_store(&lane->slots[i].seq, i);
+    }
+}
+
+zz_event_list_t *shift_event(event_shard_t *shard)
+{
+    zz_event_list_t *event = shard->event_list;
+    if (event)
+    {
+        shard->event_list = event->next;
+        if (shard->event_list == NULL)
+        {
+            shard->event_list_tail = NULL;
+        }
+        event->next = NULL;
+    }
+
+    return event;
+}
+
+void retire_event(event_shard_t *shard, zz_event_list_t *event)
+{
+    atomic_fetch_sub(&shard->n_events, 1);
+    uuid_index_remove(shard, event->uuid);
+}
+
+void cancel_event(event_shard_t *shard, zz_event_list_t *event)
+{
+    retire_event(shard, event);
+    event->flags |= EVENT_FLAG_CANCELLED;
+    shard->n_cancelled++;
+}
+
+void sweep_cancelled_events(event_shard_t *shard, zz_event_list_t **cancelled)
+{
+    zz_event_list_t *prev_event = NULL;
+    zz_event_list_t *curr_event = shard->event_list;
+    while (curr_event)
+    {
+        zz_event_list_t *next_event = curr_event->next;
+        if (curr_event->flags & EVENT_FLAG_CANCELLED)
+        {
+            if (prev_event)
+            {
+                prev_event->next = next_event;
+            }
+            else
+            {
+                shard->event_list = next_event;
+            }
+            curr_event->next = *cancelled;
+            *cancelled = curr_event;
+        }
+        else
+        {
+            prev_event = curr_event;
+        }
+        curr_event = next_event;
+    }
+    shard->event_list_tail = prev_event;
+    shard->n_cancelled = 0;
+}
+
+int uuid_index_insert(event_shard_t *shard, zz_event_list_t *event)
+{
+    uint32_t capacity = shard->uuid_index ? shard->uuid_index_mask + 1 : 0;
+
+    // Keep the load factor at or below 0.5
+    if ((atomic_load_explicit(&shard->n_events, memory_order_relaxed) + 1) * 2 > capacity)
+    {
+        uint32_t new_capacity = capacity ? capacity * 2 : UUID_INDEX_INITIAL_SIZE;
+        zz_event_list_t **new_index = calloc(new_capacity, sizeof(zz_event_list_t *));
+        if (new_index == NULL)
+        {
+            return 1;
+        }
+
+        zz_event_list_t **old_index = shard->uuid_index;
+        shard->uuid_index = new_index;
+        shard->uuid_index_mask = new_capacity - 1;
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            if (old_index[i])
+            {
+                uuid_index_place(new_index, shard->uuid_index_mask, old_index[i]);
+            }
+        }
+        free(old_index);
+    }
+
+    uuid_index_place(shard->uuid_index, shard->uuid_index_mask, event);
+
+    return 0;
+}
+
+void uuid_index_place(zz_event_list_t **index, uint32_t mask, zz_event_list_t *event)
+{
+    // Robin Hood insertion: the entries of a probe sequence stay sorted by
+    // home slot, so the removal can stop at the first entry in its home slot.
+    // The sequence numbers are consecutive, so they usually land in their
+    // home slot.
+    uint32_t slot = UUID_SEQ(event->uuid) & mask;
+    uint32_t distance = 0;
+    while (index[slot])
+    {
+        uint32_t slot_distance = (slot - UUID_SEQ(index[slot]->uuid)) & mask;
+        if (slot_distance < distance)
+        {
+            zz_event_list_t *displaced = index[slot];
+            index[slot] = event;
+            event = displaced;
+            distance = slot_distance;
+        }
+        slot = (slot + 1) & mask;
+        distance++;
+    }
+    index[slot] = event;
+}
+
+int64_t uuid_index_find(event_shard_t *shard, uint32_t uuid)
+{
+    if (shard->uuid_index == NULL || uuid == 0)
+    {
+        return -1;
+    }
+
+    zz_event_list_t **index = shard->uuid_index;
+    uint32_t mask = shard->uuid_index_mask;
+    uint32_t slot = UUID_SEQ(uuid) & mask;
+    for (uint32_t distance = 0; index[slot]; distance++)
+    {
+        if (index[slot]->uuid == uuid)
+        {
+            return slot;
+        }
+        if (((slot - UUID_SEQ(index[slot]->uuid)) & mask) < distance)
+        {
+            // The entry would have been placed before this one
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+void uuid_index_remove(event_shard_t *shard, uint32_t uuid)
+{
+    int64_t found = uuid_index_find(shard, uuid);
+    if (found < 0)
+    {
+        return;
+    }
+
+    // Backward shift deletion: move back the following entries of the probe
+    // sequence until an empty slot or an entry already in its home slot
+    zz_event_list_t **index = shard->uuid_index;
+    uint32_t mask = shard->uuid_index_mask;
+    uint32_t hole = (uint32_t)found;
+    uint32_t slot = (hole + 1) & mask;
+    while (index[slot] && (UUID_SEQ(index[slot]->uuid) & mask) != slot)
+    {
+        index[hole] = index[slot];
+        hole = slot;
+        slot = (slot + 1) & mask;
+    }
+    index[hole] = NULL;
+}
+
+void dispatch_event(event_queue_item_t *queue_item, zz_event_list_t *event)
+{
+    zz_event_route_dispatch(atomic_load(&queue_item->route_table), event);
+}
+
+void dispatch_batch(
+    int32_t queue_id,
+    const zz_event_route_t *route,
+    zz_event_list_t **events,
+    uint32_t n_events,
+    bool tracing)
+{
+    // A single slice for the whole batch, with the arrow of every event
+    if (tracing)
+    {
+        zz_event_trace_record(ZZ_EVENT_TRACE_BATCH, queue_id, events[0]->event_type, n_events);
+        for (uint32_t i = 0; i < n_events; i++)
+        {
+            zz_event_trace_record(ZZ_EVENT_TRACE_BATCH_EVENT, queue_id, events[i]->event_type, events[i]->uuid);
+        }
+    }
+
+    zz_event_route_dispatch_batch(route, events, n_events);
+
+    if (tracing)
+    {
+        zz_event_trace_record(ZZ_EVENT_TRACE_DONE, queue_id, events[0]->event_type, n_events);
+    }
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        delete_event_list(&events[i]);
+    }
+}
+
+void wake_consumer(event_queue_item_t *queue_item)
+{
+    // Only the producer clearing the flag posts the semaphore, and only when
+    // the consumer is parked, so the hot path makes no system call
+    if (atomic_load(&queue_item->parked) && atomic_exchange(&queue_item->parked, false))
+    {
+        sem_post(&queue_item->wake_sem);
+    }
+}
+
+uint32_t park_consumer(event_queue_item_t *queue_item, uint64_t deadline_ns)
+{
+    uint32_t pending = 0;
+    while (true)
+    {
+        // Publish the flag before checking the queue: a producer adding an
+        // event after the check is guaranteed to see the flag and wake us up
+        atomic_store(&queue_item->parked, true);
+        pending = queue_pending(queue_item);
+        if (pending || sleep_until(&queue_item->wake_sem, deadline_ns))
+        {
+            break;
+        }
+    }
+
+    // A producer that cleared the flag has posted (or is about to post) the
+    // semaphore, take that post so it does not wake up the next wait
+    if (!atomic_exchange(&queue_item->parked, false))
+    {
+        while (sem_wait(&queue_item->wake_sem) && errno == EINTR)
+        {
+        }
+    }
+
+    return pending ? pending : queue_pending(queue_item);
+}
+
+int sleep_until(sem_t *sem, uint64_t deadline_ns)
+{
+    if (deadline_ns == 0)
+    {
+        while (sem_wait(sem))
+        {
+            if (errno != EINTR)
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    uint64_t now_ns = getMonotonicNs();
+    if (now_ns >= deadline_ns)
+    {
+        return 1;
+    }
+
+    // sem_timedwait takes a CLOCK_REALTIME deadline
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t wait_ns = deadline_ns - now_ns;
+    deadline.tv_sec += (time_t)(wait_ns / 1000000000u);
+    deadline.tv_nsec += (long)(wait_ns % 1000000000u);
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (sem_timedwait(sem, &deadline))
+    {
+        if (errno != EINTR)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
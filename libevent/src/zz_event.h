@@ -2,11 +2,31 @@
 #define __ZZ_EVENT_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /// Queues with this ID are considered empty and free
 #define ZZ_EVENT_QUEUE_ID_UNSET -1
-/// Maximum number of simultaneous event queues
+#ifndef ZZ_EVENT_EVENT_MAX_EVENT_QUEUE
+/// Maximum number of simultaneous event queues (set by the build, see 
+/// ZZ_EVENT_MAX_EVENT_QUEUE in libevent/CMakeLists.txt)
 #define ZZ_EVENT_EVENT_MAX_EVENT_QUEUE 5
+#endif
+#ifndef ZZ_EVENT_URGENT_CAPACITY
+/// Urgent events that can be pending in a queue at the same time (power of 
+/// two)
+#define ZZ_EVENT_URGENT_CAPACITY 16
+#endif
+/// Largest payload of an urgent event
+#define ZZ_EVENT_URGENT_MAX_DATA_SIZE 32
+/// Largest number of events given at once to a batch callback
+#define ZZ_EVENT_BATCH_MAX_EVENTS 64
 
 // Forward declaration for the event type
 typedef struct zz_event_list_t zz_event_list_t;
@@ -15,6 +35,21 @@ typedef struct zz_event_callback_list_t zz_event_callback_list_t;
 
 typedef void(zz_event_callback)(zz_event_list_t *);
 
+/// Event callback receiving the context pointer given at registration
+typedef void(zz_event_ctx_callback)(zz_event_list_t *event, void *ctx);
+
+/// Releases the resources held by an event payload, called before freeing it
+typedef void(zz_event_data_destructor)(void *data);
+
+/// Notifies that an event was added to a queue
+typedef void(zz_event_ready_callback)(int32_t queue_id, void *ctx);
+
+// Forward declaration for the event batch type
+typedef struct zz_event_batch_t zz_event_batch_t;
+
+/// Event callback receiving several events of the same type at once
+typedef void(zz_event_batch_callback)(const zz_event_batch_t *batch, void *ctx);
+
 /// The event data types
 typedef enum zz_event_data_type_t
 {
@@ -26,27 +61,115 @@ typedef enum zz_event_data_type_t
     ZZ_EVENT_DATA_TYPE_UNSIGNED_INT = 2,
     /// String data type. Use data_size to know its size (strlen + null terminator)
     ZZ_EVENT_DATA_TYPE_STRING = 4,
+    /// Fixed size struct posted through a typed channel (see zz_event_channel.h)
+    ZZ_EVENT_DATA_TYPE_STRUCT = 8,
+    /// Handle of a large buffer posted by reference (see zz_event_buffer.h)
+    ZZ_EVENT_DATA_TYPE_BUFFER = 16,
 } zz_event_data_type_t;
 
+/// How a callback selects the event types it handles
+typedef enum zz_event_match_t
+{
+    /// Only the event type equal to event_type
+    ZZ_EVENT_MATCH_EXACT = 0,
+    /// Every event type in the range [event_type, event_type_last]
+    ZZ_EVENT_MATCH_RANGE = 1,
+    /// Every event type where (type & event_type_mask) == event_type
+    ZZ_EVENT_MATCH_MASK = 2,
+} zz_event_match_t;
+
+/// How a consumer waits in zz_event_wait_events for the events of a queue
+typedef enum zz_event_wait_mode_t
+{
+    /// Spin, then yield the CPU, then sleep until a producer wakes it up
+    ZZ_EVENT_WAIT_PARK = 0,
+    /// Spin until an event arrives. Lowest latency, burns a core while idle
+    ZZ_EVENT_WAIT_SPIN = 1,
+    /// Spin, then yield the CPU until an event arrives, never sleeps
+    ZZ_EVENT_WAIT_YIELD = 2,
+} zz_event_wait_mode_t;
+
+/// Spin iterations of the default wait strategy
+#define ZZ_EVENT_WAIT_DEFAULT_SPIN 1000
+/// Yield iterations of the default wait strategy
+#define ZZ_EVENT_WAIT_DEFAULT_YIELD 100
+
+/**
+ * @brief Wait strategy of the consumer of a queue
+ */
+typedef struct zz_event_wait_strategy_t
+{
+    /// The wait mode
+    zz_event_wait_mode_t mode;
+    /// Checks for events with a CPU pause in between before yielding
+    uint32_t spin_iterations;
+    /// Checks for events with a sched_yield in between before sleeping
+    uint32_t yield_iterations;
+} zz_event_wait_strategy_t;
+
 /**
  * @brief The event list type
+ *
+ * The pending events of a queue are a singly linked list, so the header is
+ * kept to 32 bytes on 64 bit targets. The payload is stored right after the
+ * header in the same allocation, use zz_event_data to access it.
  */
 struct zz_event_list_t
 {
-    /// Unique event item identifier
+    /// The next list item
+    zz_event_list_t *next;
+    /// Called with the payload when the event is released (optional)
+    zz_event_data_destructor *data_destructor;
+    /// Event identifier, unique among the pending events of its queue. 
+    /// Assigned when the event is added to the queue, never 0. Reused after 
+    /// 2^(32 - ZZ_EVENT_QUEUE_SHARD_BITS) posts by the producers of a shard.
     uint32_t uuid;
     /// The event type or category
     uint32_t event_type;
-    /// The data type transported by the data pointer
+    /// The binary size of the payload
+    uint32_t data_size;
+    /// The data type of the payload, one of zz_event_data_type_t
+    uint16_t data_type;
+    /// Reserved for the event module, 0 when the event is allocated
+    uint16_t flags;
+};
+
+/// Alignment of the payload of the events, at least the one of max_align_t
+#define ZZ_EVENT_DATA_ALIGN 16
+
+/// Offset of the payload from the start of the event
+#define ZZ_EVENT_DATA_OFFSET \
+    ((sizeof(zz_event_list_t) + ZZ_EVENT_DATA_ALIGN - 1) & ~(size_t)(ZZ_EVENT_DATA_ALIGN - 1))
+
+/**
+ * @brief Gets the payload of an event
+ *
+ * @param event [in] An event allocated by the event module
+ * @return void* The data_size bytes of payload stored after the header.
+ */
+static inline void *zz_event_data(
+    const zz_event_list_t *event)
+{
+    return (char *)event + ZZ_EVENT_DATA_OFFSET;
+}
+
+/**
+ * @brief Consecutive events of the same type given to a batch callback
+ */
+struct zz_event_batch_t
+{
+    /// The event type of all the events
+    uint32_t event_type;
+    /// The data type of all the events
     zz_event_data_type_t data_type;
-    /// A pointer to the data to be transported
-    void *data;
-    /// The binary size of the data transported by the data pointer
+    /// The binary size of every payload
     uint32_t data_size;
-    /// The previous list item
-    zz_event_list_t *prev;
-    /// The next list item
-    zz_event_list_t *next;
+    /// Number of events, up to ZZ_EVENT_BATCH_MAX_EVENTS
+    uint32_t n_events;
+    /// The payloads of the events one after the other, in the order the 
+    /// events were taken from the queue (an array of n_events items of 
+    /// data_size bytes). Aligned to max_align_t.
+    const void *data;
 };
 
 /**
@@ -54,10 +177,24 @@ struct zz_event_list_t
  */
 struct zz_event_callback_list_t
 {
-    /// The event type handled by this callback
+    /// How the event types handled by this callback are selected
+    zz_event_match_t match;
+    /// The event type handled by this callback, the first event type of a 
+    /// range or the value of a mask pattern
     uint32_t event_type;
+    /// The last event type of a range
+    uint32_t event_type_last;
+    /// The mask of a mask pattern
+    uint32_t event_type_mask;
     /// The callback to process the event
     zz_event_callback *callback;
+    /// The callback to process the event with a context (used if callback is NULL)
+    zz_event_ctx_callback *ctx_callback;
+    /// The callback to process the events in batches (used if callback and 
+    /// ctx_callback are NULL)
+    zz_event_batch_callback *batch_callback;
+    /// The context given to ctx_callback or batch_callback
+    void *ctx;
     /// The previous list item
     zz_event_callback_list_t *prev;
     /// The next list item
@@ -71,7 +208,8 @@ typedef struct zz_event_queue_t
 {
     /// Event queue id
     int32_t id;
-    /// The event list to be processed
+    /// Not used, the pending events are kept in per producer shards by the
+    /// event module
     zz_event_list_t *event_list;
     /// The event handlers callbacks
     zz_event_callback_list_t *event_callback_list;
@@ -94,6 +232,17 @@ int zz_event_init(void);
  */
 int zz_event_deinit(void);
 
+/**
+ * @brief Enables or disables the per event log messages
+ * 
+ * The log is enabled by default. Disable it when measuring the event 
+ * throughput, since printing every event dominates the processing time.
+ * 
+ * @param enabled [in] true to print a message for every event operation
+ */
+void zz_event_set_verbose(
+    bool enabled);
+
 /**
  * @brief Create a queue object
  * 
@@ -114,6 +263,89 @@ int zz_event_create_queue(
 int zz_event_delete_queue(
     int32_t queue_id);
 
+/**
+ * @brief Sets the function notified every time an event is added to a queue
+ * 
+ * Used by schedulers (see zz_event_runtime.h) to run the queue when it has 
+ * work instead of polling it. The callback is called with the queue locked,
+ * so it must be short and must not call the event API for the same queue.
+ * Once this function returns, the previous callback is no longer running
+ * and will not be called again.
+ * 
+ * @param queue_id [in] The queue to watch
+ * @param callback [in] The function to notify, NULL to stop the notifications
+ * @param ctx [in] The context given to the callback
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_set_queue_ready_callback(
+    int32_t queue_id,
+    zz_event_ready_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Sets a semaphore posted every time an urgent event is added to a queue
+ * 
+ * The ready callback is not called for the urgent events, since they can be 
+ * posted from a signal handler. Schedulers wait on this semaphore instead 
+ * (sem_post is async-signal-safe) and then look for the queues with pending
+ * urgent events. The semaphore can still be posted right after it is 
+ * replaced, so it must outlive the queue.
+ * 
+ * @param queue_id [in] The queue to watch
+ * @param sem [in] The semaphore to post, NULL to stop posting
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_set_queue_urgent_semaphore(
+    int32_t queue_id,
+    sem_t *sem);
+
+/**
+ * @brief Gets the number of urgent events waiting to be dispatched in a queue
+ * 
+ * Takes the lock of the queue list, so unlike zz_event_post_urgent_event it
+ * must not be called from a signal handler.
+ * 
+ * @param queue_id [in] The queue
+ * @param n_events [out] The pending urgent events
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_get_pending_urgent_events(
+    int32_t queue_id,
+    uint32_t *n_events);
+
+/**
+ * @brief Sets how zz_event_wait_events waits for the events of a queue
+ * 
+ * The default strategy is ZZ_EVENT_WAIT_PARK with ZZ_EVENT_WAIT_DEFAULT_SPIN 
+ * spins and ZZ_EVENT_WAIT_DEFAULT_YIELD yields.
+ * 
+ * @param queue_id [in] The queue
+ * @param strategy [in] The wait strategy
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_set_wait_strategy(
+    int32_t queue_id,
+    const zz_event_wait_strategy_t *strategy);
+
+/**
+ * @brief Waits until a queue has pending events
+ * 
+ * The caller spins first, then yields and finally sleeps, as configured with
+ * zz_event_set_wait_strategy. The producers only make a system call to wake up
+ * the consumer when it is actually sleeping, so a busy queue costs no system
+ * calls at all. Only one thread at a time can wait for a queue.
+ * 
+ * @param queue_id [in] The queue
+ * @param max_wait_us [in] Maximum time to wait in microseconds, 0 to wait
+ *                    until an event arrives
+ * @param n_pending [out] The number of pending events, 0 on timeout (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_wait_events(
+    int32_t queue_id,
+    uint64_t max_wait_us,
+    uint32_t *n_pending);
+
 /**
  * @brief Register and event callback for a given queue and event type
  * 
@@ -127,6 +359,116 @@ int zz_event_register_event_type_callback(
     uint32_t event_type,
     zz_event_callback *callback);
 
+/**
+ * @brief Register an event callback that receives a context pointer
+ * 
+ * Replaces any callback previously registered for the same event type.
+ * 
+ * @param queue_id [in] The queue where this callback will be registered
+ * @param event_type [in] The event type tied to this callback
+ * @param callback [in] The event handler callback
+ * @param ctx [in] Pointer given to the callback on every event. It must stay 
+ *            valid until the callback is removed.
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_register_event_type_ctx_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Register a callback that receives the events of a type in batches
+ * 
+ * The consecutive events of the type taken by zz_event_process_events are 
+ * given to the callback at once, with their payloads packed in an array, so 
+ * the callback can process them in a single loop (e.g. with SIMD) and post 
+ * its results with zz_event_create_events_in_queue. All the events of a batch 
+ * have the same data type and payload size, a different one starts a new 
+ * batch. The wildcard callbacks matching the type are called for every event 
+ * after the batch callback. Replaces any callback previously registered for 
+ * the same event type.
+ * 
+ * @param queue_id [in] The queue where this callback will be registered
+ * @param event_type [in] The event type tied to this callback
+ * @param callback [in] The batch handler callback
+ * @param ctx [in] Pointer given to the callback on every batch (can be NULL)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_register_event_batch_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_batch_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Register a callback for every event type in a range
+ * 
+ * Wildcard callbacks are called for the matching events after the callback 
+ * registered for the exact event type, in registration order. Registering the
+ * same range again replaces its callback.
+ * 
+ * @param queue_id [in] The queue where this callback will be registered
+ * @param first_event_type [in] The first event type of the range
+ * @param last_event_type [in] The last event type of the range (inclusive)
+ * @param callback [in] The event handler callback
+ * @param ctx [in] Pointer given to the callback on every event (can be NULL)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_register_event_range_callback(
+    int32_t queue_id,
+    uint32_t first_event_type,
+    uint32_t last_event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Register a callback for every event type matching a bit pattern
+ * 
+ * The callback is called for the events where (event_type & mask) == value,
+ * after the callback registered for the exact event type. Registering the 
+ * same pattern again replaces its callback.
+ * 
+ * @param queue_id [in] The queue where this callback will be registered
+ * @param mask [in] The bits of the event type to compare
+ * @param value [in] The expected value of the masked bits
+ * @param callback [in] The event handler callback
+ * @param ctx [in] Pointer given to the callback on every event (can be NULL)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_register_event_mask_callback(
+    int32_t queue_id,
+    uint32_t mask,
+    uint32_t value,
+    zz_event_ctx_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Removes a callback registered for a range of event types
+ * 
+ * @param queue_id [in] Queue where the callback is registered
+ * @param first_event_type [in] The first event type of the range
+ * @param last_event_type [in] The last event type of the range
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_remove_event_range_callback(
+    int32_t queue_id,
+    uint32_t first_event_type,
+    uint32_t last_event_type);
+
+/**
+ * @brief Removes a callback registered for a bit pattern of event types
+ * 
+ * @param queue_id [in] Queue where the callback is registered
+ * @param mask [in] The mask of the pattern
+ * @param value [in] The value of the pattern
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_remove_event_mask_callback(
+    int32_t queue_id,
+    uint32_t mask,
+    uint32_t value);
+
 /**
  * @brief Removes the callback for a given event in a given queue
  * 
@@ -138,6 +480,43 @@ int zz_event_remove_event_type_callback(
     int32_t queue_id,
     uint32_t event_type);
 
+/**
+ * @brief Removes the callback of an event type only if it is still the given
+ * context callback with the given context
+ * 
+ * Lets an owner of a registration remove it without removing a callback 
+ * registered later for the same event type by someone else.
+ * 
+ * @param queue_id [in] Queue where the event is registered
+ * @param event_type [in] The event type to be unregistered
+ * @param callback [in] The callback given on registration
+ * @param ctx [in] The context given on registration
+ * @return int 0 if success (also when another callback is registered),
+ *         error code otherwise.
+ */
+int zz_event_remove_event_type_ctx_callback(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_ctx_callback *callback,
+    void *ctx);
+
+/**
+ * @brief Waits until the events being dispatched from a queue by other threads
+ * when it is called are done
+ * 
+ * After removing a callback, a thread may still be running it with the 
+ * previous callbacks. Once this returns, no thread calls it anymore and its 
+ * context can be released. Callbacks may call it: the dispatch of the calling
+ * thread is not waited for. Two threads dispatching the same queue must not
+ * wait for each other from their callbacks. Concurrent calls for a queue wait
+ * one after the other.
+ * 
+ * @param queue_id [in] The queue
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_wait_dispatching(
+    int32_t queue_id);
+
 /**
  * @brief Create an event and append to a queue
  * 
@@ -146,7 +525,7 @@ int zz_event_remove_event_type_callback(
  * @param data_type [in] The data type carried by the data pointer
  * @param data [in] A pointer to the event data. 
  *             @remarks The data in this pointer is copied and handled by the 
- *             event module
+ *             event module. If NULL, the event data is zero filled.
  * @param data_size The binary size of the data
  * @param event [out] The new created event pointer
  * @return int 0 if success, error code otherwise.
@@ -159,6 +538,144 @@ int zz_event_create_event_in_queue(
     uint32_t data_size,
     zz_event_list_t *event);
 
+/**
+ * @brief Creates several events of the same type and adds them to a queue 
+ * at once
+ * 
+ * The events are added in order and taking the queue lock once. If the event
+ * type has a batch callback, the consumer takes them together and dispatches
+ * them in batches of up to ZZ_EVENT_BATCH_MAX_EVENTS, without the events of 
+ * other producers in between (only an urgent event can split a batch). 
+ * Otherwise they are interleaved with the events of the other producers like
+ * any event.
+ * 
+ * @param queue_id [in] Queue where the events will be added
+ * @param event_type [in] The event type id of all the events
+ * @param data_type [in] The data type carried by the data pointer
+ * @param data [in] The payloads, n_events items of data_size bytes one after
+ *             the other (copied). If NULL, the payloads are zero filled.
+ * @param data_size [in] The binary size of every payload
+ * @param n_events [in] Number of events to create
+ * @return int 0 if success, error code otherwise (no event is added).
+ */
+int zz_event_create_events_in_queue(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size,
+    uint32_t n_events);
+
+/**
+ * @brief Allocates an event with room for its payload, without adding it to 
+ * any queue
+ * 
+ * Allows the caller to build the payload in place (e.g. constructing an object
+ * in zz_event_data(event)) before calling zz_event_post_event. The payload is 
+ * zero filled and aligned to max_align_t.
+ * 
+ * @param event_type [in] The event type id
+ * @param data_type [in] The data type carried by the data pointer
+ * @param data_size [in] The binary size of the payload
+ * @param event [out] The new event. Owned by the caller until it is posted.
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_alloc_event(
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    uint32_t data_size,
+    zz_event_list_t **event);
+
+/**
+ * @brief Appends an event created by zz_event_alloc_event to a queue
+ * 
+ * The event module takes the ownership of the event, even on failure. The
+ * events posted by a thread are processed in the order they were posted, the
+ * events of different threads are interleaved.
+ * 
+ * @param queue_id [in] Queue where the event will be registered
+ * @param event [in] The event to be added
+ * @param uuid [out] The uuid assigned to the event, to cancel it (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_post_event(
+    int32_t queue_id,
+    zz_event_list_t *event,
+    uint32_t *uuid);
+
+/**
+ * @brief Releases an event that was allocated but never posted
+ * 
+ * @param event [in] The event created by zz_event_alloc_event
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_free_event(
+    zz_event_list_t *event);
+
+/**
+ * @brief Adds an event to the urgent lane of a queue
+ * 
+ * Async-signal-safe: it does not allocate, lock or print, so it can be 
+ * called from a signal handler or while the caller holds a lock taken by the 
+ * event module. The event is copied into a slot preallocated in the queue and 
+ * dispatched before any other pending event. The urgent events are not 
+ * captured, can not be cancelled and do not notify the ready callback of the 
+ * queue (see zz_event_set_queue_urgent_semaphore instead). The 
+ * consumer dispatches them from its stack without allocating, alone (never in
+ * a batch), and the event given to the callbacks is only valid during the call.
+ * 
+ * @param queue_id [in] Queue where the event will be added
+ * @param event_type [in] The event type id
+ * @param data_type [in] The data type carried by the data pointer
+ * @param data [in] The event data, copied (can be NULL if data_size is 0)
+ * @param data_size [in] The binary size of the data, up to 
+ *                  ZZ_EVENT_URGENT_MAX_DATA_SIZE
+ * @return int 0 if success, error code if the queue does not exist, the 
+ * payload is too large or ZZ_EVENT_URGENT_CAPACITY urgent events are already 
+ * pending.
+ */
+int zz_event_post_urgent_event(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size);
+
+/**
+ * @brief Removes a pending event from a queue without dispatching it
+ * 
+ * Safe to call while other threads add or process events of the queue: the 
+ * event is either cancelled or dispatched, never both. The event is released
+ * (and its data destructor called) later, by the consumer of the queue or by
+ * the next cancellation.
+ * 
+ * The uuids of a queue are reused once the producers of a shard have posted
+ * 2^(32 - ZZ_EVENT_QUEUE_SHARD_BITS) events (2^29 with the default 8 
+ * shards), so a uuid kept longer than that can cancel a newer event. Cancel
+ * the events, or forget their uuid, once they are known to be dispatched.
+ * 
+ * @param queue_id [in] Queue where the event was posted
+ * @param uuid [in] The uuid returned by zz_event_post_event
+ * @return int 0 if the event was cancelled, error code if the queue does not
+ * exist or the event is not pending anymore.
+ */
+int zz_event_cancel(
+    int32_t queue_id,
+    uint32_t uuid);
+
+/**
+ * @brief Removes all the pending events of a type from a queue
+ * 
+ * @param queue_id [in] Queue to be cleaned
+ * @param event_type [in] The event type to be cancelled
+ * @param n_cancelled [out] The number of events cancelled (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_cancel_by_type(
+    int32_t queue_id,
+    uint32_t event_type,
+    uint32_t *n_cancelled);
+
 /**
  * @brief Process the events in a given queue
  * 
@@ -170,4 +687,55 @@ int zz_event_process_events(
     int32_t queue_id,
     int32_t *n_events);
 
+/**
+ * @brief Process the events in a given queue within a budget
+ * 
+ * Stops when the queue is empty or when any of the limits is reached, so a 
+ * producer adding events faster than they are processed can not keep the 
+ * caller inside this function.
+ * 
+ * @param queue_id [in] the id of the queue to process
+ * @param max_events [in] Maximum number of events to process, 0 for no limit
+ * @param max_time_us [in] Time budget in microseconds, 0 for no limit. It is 
+ *                    checked after each event, so a slow callback can exceed it.
+ * @param n_events [out] The number of events processed (optional)
+ * @param n_remaining [out] The number of events left in the queue (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_process_events_budget(
+    int32_t queue_id,
+    uint32_t max_events,
+    uint64_t max_time_us,
+    int32_t *n_events,
+    uint32_t *n_remaining);
+
+/**
+ * @brief Process several queues in round robin within a budget
+ * 
+ * Every pass processes at most max_events_per_queue events of each queue, in 
+ * the given order, and the passes repeat until all the queues are empty or 
+ * the time budget is over.
+ * 
+ * @param queue_ids [in] The ids of the queues to process
+ * @param n_queues [in] The number of queue ids
+ * @param max_events_per_queue [in] Maximum events of one queue per pass, 0 to
+ *                             drain each queue in a single pass
+ * @param max_time_us [in] Time budget in microseconds for all the queues, 0 
+ *                    for no limit
+ * @param n_events [out] The number of events processed (optional)
+ * @param n_remaining [out] The number of events left in the queues (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_process_queues(
+    const int32_t *queue_ids,
+    uint32_t n_queues,
+    uint32_t max_events_per_queue,
+    uint64_t max_time_us,
+    int32_t *n_events,
+    uint32_t *n_remaining);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // __ZZ_EVENT_H__
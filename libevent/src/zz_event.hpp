@@ -0,0 +1,265 @@
+#ifndef __ZZ_EVENT_HPP__
+#define __ZZ_EVENT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "zz_event.h"
+
+/**
+ * @brief Header only C++17 layer over the zz_event C API
+ *
+ * Payloads are constructed directly in the event storage and handlers can be
+ * capturing lambdas, stored inline in the registration object (no heap
+ * allocation, no std::function).
+ *
+ * @code
+ * zz::Queue<Frame> queue(FRAME_QUEUE);
+ * auto registration = queue.on(EVENT_FRAME, [&stats](Frame &frame) { stats.add(frame); });
+ * queue.post(EVENT_FRAME, std::move(frame));
+ * queue.process();
+ * @endcode
+ */
+namespace zz
+{
+
+namespace detail
+{
+
+template <typename T>
+void destroy(void *data)
+{
+    static_cast<T *>(data)->~T();
+}
+
+/// Checks if an event posted with a data type can carry a T. The C++ layer
+/// posts STRUCT, the C API may post the integers with their own data type.
+template <typename T>
+bool accepts_data_type(uint16_t data_type)
+{
+    if (data_type == ZZ_EVENT_DATA_TYPE_STRUCT)
+    {
+        return true;
+    }
+    if constexpr (std::is_integral_v<T>)
+    {
+        return data_type == (std::is_signed_v<T> ? ZZ_EVENT_DATA_TYPE_SIGNED_INT : ZZ_EVENT_DATA_TYPE_UNSIGNED_INT);
+    }
+    return false;
+}
+
+} // namespace detail
+
+/**
+ * @brief Gets the payload of an event as a T
+ *
+ * @param event [in] The event
+ * @return The payload, nullptr if the event does not carry a T (e.g. posted
+ *         through the C API with another size or data type)
+ */
+template <typename T>
+T *payload(zz_event_list_t *event)
+{
+    if (event->data_size != sizeof(T) || !detail::accepts_data_type<T>(event->data_type))
+    {
+        std::fprintf(stderr, "Event type %u of %u bytes (data type %u) does not carry a payload of %zu bytes.\n",
+                     event->event_type, event->data_size, (unsigned)event->data_type, sizeof(T));
+        return nullptr;
+    }
+    return static_cast<T *>(zz_event_data(event));
+}
+
+/**
+ * @brief Constructs a T in the storage of a new event and appends it to a queue
+ *
+ * @param queue_id [in] Queue where the event will be added
+ * @param event_type [in] The event type id
+ * @param args [in] The arguments forwarded to the T constructor
+ * @return int 0 if success, error code otherwise.
+ */
+template <typename T, typename... Args>
+int emplace(int32_t queue_id, uint32_t event_type, Args &&...args)
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "zz::emplace payload alignment greater than max_align_t");
+
+    zz_event_list_t *event = nullptr;
+    if (zz_event_alloc_event(event_type, ZZ_EVENT_DATA_TYPE_STRUCT, sizeof(T), &event))
+    {
+        return 1;
+    }
+
+    try
+    {
+        new (zz_event_data(event)) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        zz_event_free_event(event);
+        throw;
+    }
+
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+        event->data_destructor = &detail::destroy<T>;
+    }
+
+    return zz_event_post_event(queue_id, event, nullptr);
+}
+
+/// Moves (or copies) a payload into a new event and appends it to a queue
+template <typename T>
+int post(int32_t queue_id, uint32_t event_type, T &&payload)
+{
+    return emplace<std::decay_t<T>>(queue_id, event_type, std::forward<T>(payload));
+}
+
+/**
+ * @brief Keeps a handler registered while it is alive
+ *
+ * The handler is stored inside the registration and its address is used as
+ * the callback context, so the registration can not be copied or moved.
+ * Return it from Queue::on with guaranteed copy elision (auto r = q.on(...)).
+ * The destructor waits for the other threads dispatching the queue, so the
+ * handler is not running anywhere else once the registration is gone.
+ */
+template <typename T, typename F>
+class Registration
+{
+public:
+    template <typename G>
+    Registration(int32_t queue_id, uint32_t event_type, G &&handler)
+        : queue_id_(queue_id), event_type_(event_type), handler_(std::forward<G>(handler))
+    {
+        if (zz_event_register_event_type_ctx_callback(queue_id_, event_type_, &dispatch, this))
+        {
+            throw std::runtime_error("Unable to register handler in queue " + std::to_string(queue_id_));
+        }
+    }
+
+    ~Registration()
+    {
+        // Leave a handler registered since for the same type in place, and
+        // do not release the handler while another thread is running it
+        if (zz_event_remove_event_type_ctx_callback(queue_id_, event_type_, &dispatch, this) == 0)
+        {
+            zz_event_wait_dispatching(queue_id_);
+        }
+    }
+
+    Registration(const Registration &) = delete;
+    Registration &operator=(const Registration &) = delete;
+
+private:
+    static void dispatch(zz_event_list_t *event, void *ctx)
+    {
+        // The events of the type posted with another payload are skipped
+        T *data = payload<T>(event);
+        if (data)
+        {
+            auto *self = static_cast<Registration *>(ctx);
+            self->handler_(*data);
+        }
+    }
+
+    int32_t queue_id_;
+    uint32_t event_type_;
+    F handler_;
+};
+
+/**
+ * @brief Event queue carrying payloads of type T
+ *
+ * Creates the queue on construction and deletes it (with its pending events)
+ * on destruction. All the event types posted and handled through this object
+ * carry a T.
+ */
+template <typename T>
+class Queue
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "zz::Queue payload alignment greater than max_align_t");
+
+public:
+    explicit Queue(int32_t queue_id)
+        : id_(queue_id)
+    {
+        if (zz_event_create_queue(id_))
+        {
+            throw std::runtime_error("Unable to create queue " + std::to_string(id_));
+        }
+    }
+
+    ~Queue()
+    {
+        zz_event_delete_queue(id_);
+    }
+
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+
+    /// The id of the underlying C queue
+    int32_t id() const
+    {
+        return id_;
+    }
+
+    /**
+     * @brief Constructs the payload in the event storage and appends the event
+     *
+     * @return int 0 if success, error code otherwise.
+     */
+    template <typename... Args>
+    int emplace(uint32_t event_type, Args &&...args)
+    {
+        return zz::emplace<T>(id_, event_type, std::forward<Args>(args)...);
+    }
+
+    /// Moves the payload into the event storage and appends the event
+    int post(uint32_t event_type, T &&payload)
+    {
+        return emplace(event_type, std::move(payload));
+    }
+
+    /// Copies the payload into the event storage and appends the event
+    int post(uint32_t event_type, const T &payload)
+    {
+        return emplace(event_type, payload);
+    }
+
+    /**
+     * @brief Registers a handler, callable as void(T &), for an event type
+     *
+     * @return The registration that keeps the handler alive and registered
+     */
+    template <typename F>
+    Registration<T, std::decay_t<F>> on(uint32_t event_type, F &&handler)
+    {
+        return Registration<T, std::decay_t<F>>(id_, event_type, std::forward<F>(handler));
+    }
+
+    /**
+     * @brief Process the pending events of the queue in the calling thread
+     *
+     * @return int32_t The number of events processed
+     */
+    int32_t process()
+    {
+        int32_t n_events = 0;
+        zz_event_process_events(id_, &n_events);
+        return n_events;
+    }
+
+private:
+    int32_t id_;
+};
+
+} // namespace zz
+
+#endif // __ZZ_EVENT_HPP__
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+
+#include "zz_event_buffer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+/// Number of buffer capacities kept in the pool
+#define BUFFER_CLASSES (ZZ_EVENT_BUFFER_MAX_SHIFT - ZZ_EVENT_BUFFER_MIN_SHIFT + 1)
+
+/// Size of a transparent huge page on x86_64 and aarch64 (4 KiB pages)
+#define HUGE_PAGE_SIZE (2u * 1024u * 1024u)
+
+/// Free buffers by [shared][capacity class]
+static zz_event_buffer_t *free_buffers[2][BUFFER_CLASSES];
+
+static uint32_t n_free_buffers[2][BUFFER_CLASSES];
+
+static pthread_mutex_t pool_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+// Private prototypes
+int32_t buffer_class(
+    uint64_t size);
+
+int map_buffer(
+    zz_event_buffer_t *buffer);
+
+void unmap_buffer(
+    zz_event_buffer_t *buffer);
+
+void populate_buffer(
+    zz_event_buffer_t *buffer);
+
+void release_event_buffer(
+    void *data);
+
+// Public implementation
+int zz_event_buffer_alloc(
+    uint64_t size,
+    uint32_t flags,
+    zz_event_buffer_t **buffer)
+{
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "buffer must not be null.\n");
+        return 1;
+    }
+    *buffer = NULL;
+
+    int32_t class = buffer_class(size);
+    if (class < 0)
+    {
+        fprintf(stderr, "Buffer of %" PRIu64 " bytes is too large.\n", size);
+        return 1;
+    }
+    uint32_t shared = (flags & ZZ_EVENT_BUFFER_SHARED) ? 1 : 0;
+
+    pthread_mutex_lock(&pool_mtx);
+    zz_event_buffer_t *new_buffer = free_buffers[shared][class];
+    if (new_buffer)
+    {
+        free_buffers[shared][class] = new_buffer->next;
+        n_free_buffers[shared][class]--;
+    }
+    pthread_mutex_unlock(&pool_mtx);
+
+    if (new_buffer == NULL)
+    {
+        new_buffer = calloc(1, sizeof(zz_event_buffer_t));
+        if (new_buffer == NULL)
+        {
+            fprintf(stderr, "Unable to allocate a buffer handle.\n");
+            return 1;
+        }
+        new_buffer->capacity = (uint64_t)1 << (class + ZZ_EVENT_BUFFER_MIN_SHIFT);
+        new_buffer->flags = flags;
+        new_buffer->fd = -1;
+        // Only the requested size is populated
+        new_buffer->size = size;
+
+        if (map_buffer(new_buffer))
+        {
+            free(new_buffer);
+            return 1;
+        }
+    }
+
+    new_buffer->size = size;
+    new_buffer->next = NULL;
+    *buffer = new_buffer;
+
+    return 0;
+}
+
+void zz_event_buffer_release(
+    zz_event_buffer_t *buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    int32_t class = buffer_class(buffer->capacity);
+    uint32_t shared = (buffer->flags & ZZ_EVENT_BUFFER_SHARED) ? 1 : 0;
+
+    pthread_mutex_lock(&pool_mtx);
+    if (n_free_buffers[shared][class] < ZZ_EVENT_BUFFER_POOL_DEPTH)
+    {
+        buffer->next = free_buffers[shared][class];
+        free_buffers[shared][class] = buffer;
+        n_free_buffers[shared][class]++;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&pool_mtx);
+
+    // The pool is full, unmap out of the lock
+    if (buffer)
+    {
+        unmap_buffer(buffer);
+        free(buffer);
+    }
+}
+
+void zz_event_buffer_pool_trim(void)
+{
+    zz_event_buffer_t *trimmed = NULL;
+
+    pthread_mutex_lock(&pool_mtx);
+    for (uint32_t shared = 0; shared < 2; shared++)
+    {
+        for (uint32_t class = 0; class < BUFFER_CLASSES; class++)
+        {
+            while (free_buffers[shared][class])
+            {
+                zz_event_buffer_t *buffer = free_buffers[shared][class];
+                free_buffers[shared][class] = buffer->next;
+                buffer->next = trimmed;
+                trimmed = buffer;
+            }
+            n_free_buffers[shared][class] = 0;
+        }
+    }
+    pthread_mutex_unlock(&pool_mtx);
+
+    while (trimmed)
+    {
+        zz_event_buffer_t *next_buffer = trimmed->next;
+        unmap_buffer(trimmed);
+        free(trimmed);
+        trimmed = next_buffer;
+    }
+}
+
+int zz_event_post_buffer(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_buffer_t *buffer,
+    uint32_t *uuid)
+{
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "buffer must not be null.\n");
+        return 1;
+    }
+
+    zz_event_list_t *event = NULL;
+    if (zz_event_alloc_event(event_type, ZZ_EVENT_DATA_TYPE_BUFFER, sizeof(zz_event_buffer_t *), &event))
+    {
+        zz_event_buffer_release(buffer);
+        return 1;
+    }
+
+    // Only the handle is copied, the event releases the buffer with it
+    memcpy(zz_event_data(event), &buffer, sizeof(zz_event_buffer_t *));
+    event->data_destructor = &release_event_buffer;
+
+    return zz_event_post_event(queue_id, event, uuid);
+}
+
+zz_event_buffer_t *zz_event_buffer_from_event(
+    const zz_event_list_t *event)
+{
+    if (event == NULL || event->data_type != ZZ_EVENT_DATA_TYPE_BUFFER ||
+        event->data_size != sizeof(zz_event_buffer_t *))
+    {
+        return NULL;
+    }
+
+    zz_event_buffer_t *buffer = NULL;
+    memcpy(&buffer, zz_event_data(event), sizeof(zz_event_buffer_t *));
+
+    return buffer;
+}
+
+zz_event_buffer_t *zz_event_buffer_take(
+    zz_event_list_t *event)
+{
+    zz_event_buffer_t *buffer = zz_event_buffer_from_event(event);
+    if (buffer)
+    {
+        // The destructor finds no handle and leaves the buffer alone
+        memset(zz_event_data(event), 0, sizeof(zz_event_buffer_t *));
+    }
+
+    return buffer;
+}
+
+// Private implementations
+int32_t buffer_class(uint64_t size)
+{
+    if (size > ((uint64_t)1 << ZZ_EVENT_BUFFER_MAX_SHIFT))
+    {
+        return -1;
+    }
+
+    int32_t class = 0;
+    uint64_t capacity = (uint64_t)1 << ZZ_EVENT_BUFFER_MIN_SHIFT;
+    while (capacity < size)
+    {
+        capacity <<= 1;
+        class++;
+    }
+
+    return class;
+}
+
+int map_buffer(zz_event_buffer_t *buffer)
+{
+    uint64_t capacity = buffer->capacity;
+    bool shared = buffer->flags & ZZ_EVENT_BUFFER_SHARED;
+
+    if (shared)
+    {
+        buffer->fd = memfd_create("zz_event_buffer", MFD_CLOEXEC);
+        if (buffer->fd < 0 || ftruncate(buffer->fd, (off_t)capacity))
+        {
+            fprintf(stderr, "Unable to create a shared buffer of %" PRIu64 " bytes. Err: %d\n", capacity, errno);
+            if (buffer->fd >= 0)
+            {
+                close(buffer->fd);
+                buffer->fd = -1;
+            }
+            return 1;
+        }
+    }
+
+    // Reserve room to align the buffer to a huge page, so the kernel can back
+    // it with huge pages from the first byte, then map it over the reservation
+    uint64_t alignment = capacity >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : 0;
+    uint64_t reserved_size = capacity + alignment;
+    char *reserved = mmap(NULL, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map a buffer of %" PRIu64 " bytes. Err: %d\n", capacity, errno);
+        unmap_buffer(buffer);
+        return 1;
+    }
+
+    char *aligned = reserved;
+    if (alignment)
+    {
+        aligned = (char *)(((uintptr_t)reserved + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        if (aligned > reserved)
+        {
+            munmap(reserved, (size_t)(aligned - reserved));
+        }
+        if (reserved + reserved_size > aligned + capacity)
+        {
+            munmap(aligned + capacity, (size_t)(reserved + reserved_size - (aligned + capacity)));
+        }
+    }
+
+    void *data = shared
+                     ? mmap(aligned, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, buffer->fd, 0)
+                     : mmap(aligned, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map a buffer of %" PRIu64 " bytes. Err: %d\n", capacity, errno);
+        munmap(aligned, capacity);
+        unmap_buffer(buffer);
+        return 1;
+    }
+    buffer->data = data;
+
+    if (alignment)
+    {
+        // Only a hint, the buffer works with normal pages as well
+        madvise(buffer->data, capacity, MADV_HUGEPAGE);
+    }
+    populate_buffer(buffer);
+
+    return 0;
+}
+
+void unmap_buffer(zz_event_buffer_t *buffer)
+{
+    if (buffer->data)
+    {
+        munmap(buffer->data, buffer->capacity);
+        buffer->data = NULL;
+    }
+    if (buffer->fd >= 0)
+    {
+        close(buffer->fd);
+        buffer->fd = -1;
+    }
+}
+
+void populate_buffer(zz_event_buffer_t *buffer)
+{
+    // Fault in the pages of the requested size now, in a single call when the
+    // kernel supports it, instead of once per page while the producer writes
+    // the buffer. The rest of the capacity is faulted in only if it is used.
+    uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t populate_size = (buffer->size + page_size - 1) / page_size * page_size;
+    if (populate_size > buffer->capacity)
+    {
+        populate_size = buffer->capacity;
+    }
+#ifdef MADV_POPULATE_WRITE
+    if (populate_size == 0 || madvise(buffer->data, populate_size, MADV_POPULATE_WRITE) == 0)
+    {
+        return;
+    }
+#endif
+
+    volatile char *data = buffer->data;
+    for (uint64_t offset = 0; offset < populate_size; offset += page_size)
+    {
+        data[offset] = 0;
+    }
+}
+
+void release_event_buffer(void *data)
+{
+    zz_event_buffer_t *buffer = NULL;
+    memcpy(&buffer, data, sizeof(zz_event_buffer_t *));
+    zz_event_buffer_release(buffer);
+}
@@ -0,0 +1,146 @@
+#ifndef __ZZ_EVENT_BUFFER_H__
+#define __ZZ_EVENT_BUFFER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "zz_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Large payloads passed through the queues by reference.
+ *
+ * The event payload is limited to 4 GiB and copied into every event. Big
+ * payloads (frames, files, tensors) are allocated instead as buffers, mapped
+ * directly from the kernel and kept in a pool after use, and only their
+ * handle travels in the event. The buffer goes back to the pool when the
+ * event is released after dispatch.
+ *
+ * @code
+ * zz_event_buffer_t *frame = NULL;
+ * zz_event_buffer_alloc(width * height * 4, 0, &frame);
+ * render(frame->data);
+ * zz_event_post_buffer(GUI_EVENT_QUEUE, EVENT_GUI_FRAME, frame, NULL);
+ * ...
+ * void on_frame(zz_event_list_t *event)
+ * {
+ *     zz_event_buffer_t *frame = zz_event_buffer_from_event(event);
+ *     show(frame->data, frame->size);
+ * }
+ * @endcode
+ */
+
+/// Smallest buffer capacity, as a power of two (64 KiB)
+#define ZZ_EVENT_BUFFER_MIN_SHIFT 16
+/// Largest buffer capacity, as a power of two (1 TiB)
+#define ZZ_EVENT_BUFFER_MAX_SHIFT 40
+/// Buffers of the same capacity kept in the pool after they are released
+#define ZZ_EVENT_BUFFER_POOL_DEPTH 8
+
+/// The buffer is backed by a memfd, so its fd can be passed to other processes
+#define ZZ_EVENT_BUFFER_SHARED 0x1
+
+/**
+ * @brief A large buffer allocated from the pool
+ */
+typedef struct zz_event_buffer_t zz_event_buffer_t;
+struct zz_event_buffer_t
+{
+    /// The buffer memory, page aligned. Recycled buffers keep their old
+    /// content, they are not zero filled.
+    void *data;
+    /// Number of bytes in use, set to the requested size on allocation
+    uint64_t size;
+    /// Number of bytes mapped, a power of two
+    uint64_t capacity;
+    /// memfd of a ZZ_EVENT_BUFFER_SHARED buffer, -1 otherwise
+    int fd;
+    /// Flags given on allocation
+    uint32_t flags;
+    /// Next buffer in the pool
+    zz_event_buffer_t *next;
+};
+
+/**
+ * @brief Gets a buffer from the pool, mapping a new one if the pool is empty
+ *
+ * New buffers are backed by transparent huge pages when the capacity allows it
+ * and the pages of the requested size are populated before returning, so the
+ * producer does not take a page fault for every 4 KiB it writes. The rest of
+ * the capacity (rounded up to a power of two) is only faulted in when used.
+ *
+ * @param size [in] Bytes needed, up to 2^ZZ_EVENT_BUFFER_MAX_SHIFT
+ * @param flags [in] 0 or ZZ_EVENT_BUFFER_SHARED
+ * @param buffer [out] The buffer, owned by the caller until it is posted
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_buffer_alloc(
+    uint64_t size,
+    uint32_t flags,
+    zz_event_buffer_t **buffer);
+
+/**
+ * @brief Gives a buffer back to the pool
+ *
+ * The buffer is unmapped if the pool already holds ZZ_EVENT_BUFFER_POOL_DEPTH
+ * buffers of its capacity.
+ *
+ * @param buffer [in] The buffer to release (can be NULL)
+ */
+void zz_event_buffer_release(
+    zz_event_buffer_t *buffer);
+
+/**
+ * @brief Unmaps all the buffers kept in the pool
+ */
+void zz_event_buffer_pool_trim(void);
+
+/**
+ * @brief Appends an event carrying a buffer to a queue
+ *
+ * The event owns the buffer from now on, also if the post fails, and returns
+ * it to the pool once the event is dispatched or cancelled.
+ *
+ * @param queue_id [in] Queue where the event will be added
+ * @param event_type [in] The event type id
+ * @param buffer [in] The buffer to pass
+ * @param uuid [out] The uuid assigned to the event (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_post_buffer(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_buffer_t *buffer,
+    uint32_t *uuid);
+
+/**
+ * @brief Gets the buffer carried by an event
+ *
+ * @param event [in] The event being dispatched
+ * @return The buffer, NULL if the event does not carry a buffer or it was
+ *         taken already.
+ */
+zz_event_buffer_t *zz_event_buffer_from_event(
+    const zz_event_list_t *event);
+
+/**
+ * @brief Takes the ownership of the buffer carried by an event
+ *
+ * Lets a callback keep the buffer after the dispatch (e.g. to forward it to
+ * another queue) instead of returning it to the pool.
+ *
+ * @param event [in] The event being dispatched
+ * @return The buffer, released by the caller with zz_event_buffer_release or
+ *         zz_event_post_buffer. NULL if the event does not carry a buffer.
+ */
+zz_event_buffer_t *zz_event_buffer_take(
+    zz_event_list_t *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZZ_EVENT_BUFFER_H__
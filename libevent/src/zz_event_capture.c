@@ -0,0 +1,693 @@
+#include "zz_event_capture.h"
+#include "zz_event_buffer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <utils.h>
+
+/// Size of the stdio buffer of the capture file
+#define CAPTURE_BUFFER_SIZE (1024 * 1024)
+/// Initial size of the buffer where each thread keeps its records, flushed
+/// once half full
+#define CAPTURE_THREAD_BUFFER_SIZE (256 * 1024)
+/// Gaps between replayed events shorter than this are busy waited
+#define REPLAY_SPIN_THRESHOLD_NS 50000
+
+/**
+ * @brief The records of one thread, written to the file when a buffer is full
+ * or the capture stops
+ */
+typedef struct capture_buffer_t capture_buffer_t;
+struct capture_buffer_t
+{
+    /// Records (header and payload) in timestamp order
+    unsigned char *data;
+    /// Bytes of committed records
+    size_t size;
+    size_t capacity;
+    /// Held by the owner thread from zz_event_capture_record to
+    /// zz_event_capture_commit, and by the flush
+    pthread_mutex_t mtx;
+    /// Set when the owner thread exits, the buffer is released once flushed
+    atomic_bool exited;
+    capture_buffer_t *next;
+};
+
+/// Protects the capture file and the buffer list
+static pthread_mutex_t capture_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_bool capture_active = false;
+
+static FILE *capture_file = NULL;
+
+static char *capture_buffer = NULL;
+
+static uint64_t capture_start_ns = 0;
+
+/// ZZ_EVENT_CAPTURE_FLAG_* of the next capture
+static atomic_uint next_capture_flags = 0;
+
+/// ZZ_EVENT_CAPTURE_FLAG_* of the running capture
+static uint32_t capture_flags = 0;
+
+/// The buffers of all the threads that recorded something
+static capture_buffer_t *capture_buffers = NULL;
+
+/// Buffer of the calling thread
+static _Thread_local capture_buffer_t *thread_capture_buffer = NULL;
+
+/// Bytes of records staged by the calling thread after its committed ones,
+/// not 0 while it holds the lock of its buffer
+static _Thread_local size_t staged_size = 0;
+
+/// Marks the buffer of a thread as exited when the thread ends
+static pthread_key_t capture_buffer_key;
+
+static pthread_once_t capture_buffer_key_once = PTHREAD_ONCE_INIT;
+
+// Private prototypes
+void create_capture_buffer_key(void);
+
+void mark_capture_buffer_exited(
+    void *data);
+
+capture_buffer_t *get_capture_buffer(void);
+
+int reserve_capture_buffer(
+    capture_buffer_t *buffer,
+    size_t size);
+
+void flush_capture_buffers(void);
+
+void release_exited_capture_buffers(void);
+
+int replay_record(
+    const zz_event_capture_record_t *record,
+    const void *payload,
+    uint32_t flags);
+
+FILE *open_trace(
+    const char *path,
+    uint32_t *flags);
+
+int read_record(
+    FILE *file,
+    zz_event_capture_record_t *record,
+    void **payload,
+    uint32_t *payload_capacity);
+
+void wait_until_ns(
+    uint64_t deadline_ns);
+
+// Public implementation
+int zz_event_capture_start(
+    const char *path)
+{
+    pthread_mutex_lock(&capture_mtx);
+    if (capture_file)
+    {
+        pthread_mutex_unlock(&capture_mtx);
+        fprintf(stderr, "There is already a capture running.\n");
+        return 1;
+    }
+
+    capture_file = fopen(path, "wb");
+    if (capture_file == NULL)
+    {
+        pthread_mutex_unlock(&capture_mtx);
+        fprintf(stderr, "Unable to create capture file <%s>. Err: %d\n", path, errno);
+        return 1;
+    }
+
+    capture_buffer = malloc(CAPTURE_BUFFER_SIZE);
+    setvbuf(capture_file, capture_buffer, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    zz_event_capture_header_t header = {0};
+    memcpy(header.magic, ZZ_EVENT_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = ZZ_EVENT_CAPTURE_VERSION;
+    capture_flags = atomic_load(&next_capture_flags);
+    header.flags = capture_flags;
+    fwrite(&header, sizeof(header), 1, capture_file);
+
+    // Nothing is left in the buffers of the previous capture, it was flushed
+    // when it stopped
+    release_exited_capture_buffers();
+    capture_start_ns = getMonotonicNs();
+    atomic_store(&capture_active, true);
+    pthread_mutex_unlock(&capture_mtx);
+
+    return 0;
+}
+
+int zz_event_capture_stop(void)
+{
+    pthread_mutex_lock(&capture_mtx);
+    atomic_store(&capture_active, false);
+    if (capture_file == NULL)
+    {
+        pthread_mutex_unlock(&capture_mtx);
+        fprintf(stderr, "There is no capture running.\n");
+        return 1;
+    }
+    pthread_mutex_unlock(&capture_mtx);
+
+    // The events being added when the capture stopped are committed first
+    flush_capture_buffers();
+
+    pthread_mutex_lock(&capture_mtx);
+    release_exited_capture_buffers();
+    int err = fclose(capture_file);
+    capture_file = NULL;
+    free(capture_buffer);
+    capture_buffer = NULL;
+    pthread_mutex_unlock(&capture_mtx);
+
+    return err ? 1 : 0;
+}
+
+void zz_event_capture_set_buffer_content(
+    bool enabled)
+{
+    if (enabled)
+    {
+        atomic_fetch_or(&next_capture_flags, ZZ_EVENT_CAPTURE_FLAG_BUFFER_CONTENT);
+    }
+    else
+    {
+        atomic_fetch_and(&next_capture_flags, ~(unsigned int)ZZ_EVENT_CAPTURE_FLAG_BUFFER_CONTENT);
+    }
+}
+
+bool zz_event_capture_is_active(void)
+{
+    return atomic_load_explicit(&capture_active, memory_order_relaxed);
+}
+
+int zz_event_capture_record(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size)
+{
+    capture_buffer_t *buffer = thread_capture_buffer ? thread_capture_buffer : get_capture_buffer();
+    if (buffer == NULL)
+    {
+        return 1;
+    }
+
+    if (staged_size == 0)
+    {
+        pthread_mutex_lock(&buffer->mtx);
+        // Checked with the lock taken: once the capture is stopped, its final
+        // flush waits for the records staged before, and no other capture
+        // (with other flags) can start
+        if (!atomic_load(&capture_active))
+        {
+            pthread_mutex_unlock(&buffer->mtx);
+            return 1;
+        }
+    }
+
+    // The handle of a buffer means nothing in a replay, it is recorded by
+    // size, or by content if enabled when the capture started
+    uint64_t buffer_size = 0;
+    if (data_type == ZZ_EVENT_DATA_TYPE_BUFFER && data)
+    {
+        const zz_event_buffer_t *event_buffer = NULL;
+        memcpy(&event_buffer, data, sizeof(event_buffer));
+        buffer_size = event_buffer ? event_buffer->size : 0;
+        if ((capture_flags & ZZ_EVENT_CAPTURE_FLAG_BUFFER_CONTENT) == 0)
+        {
+            data = &buffer_size;
+            data_size = sizeof(buffer_size);
+        }
+        else if (buffer_size > UINT32_MAX)
+        {
+            fprintf(stderr, "Buffer of %" PRIu64 " bytes recorded without its content.\n", buffer_size);
+            data = NULL;
+        }
+        else
+        {
+            data = event_buffer ? event_buffer->data : NULL;
+            data_size = (uint32_t)buffer_size;
+        }
+    }
+
+    zz_event_capture_record_t record;
+    record.timestamp_ns = 0;
+    record.queue_id = queue_id;
+    record.event_type = event_type;
+    record.data_type = (uint32_t)data_type;
+    record.data_size = data ? data_size : 0;
+    size_t record_size = sizeof(record) + record.data_size;
+
+    // Staged after the committed records, the timestamp is set on commit
+    if (reserve_capture_buffer(buffer, buffer->size + staged_size + record_size) == 0)
+    {
+        unsigned char *staged = buffer->data + buffer->size + staged_size;
+        memcpy(staged, &record, sizeof(record));
+        if (record.data_size)
+        {
+            memcpy(staged + sizeof(record), data, record.data_size);
+        }
+        staged_size += record_size;
+    }
+    else
+    {
+        fprintf(stderr, "Unable to capture an event of %u bytes.\n", record.data_size);
+    }
+
+    if (staged_size == 0)
+    {
+        pthread_mutex_unlock(&buffer->mtx);
+        return 1;
+    }
+
+    return 0;
+}
+
+int zz_event_capture_commit(
+    bool added)
+{
+    capture_buffer_t *buffer = thread_capture_buffer;
+    if (buffer == NULL || staged_size == 0)
+    {
+        return 1;
+    }
+
+    if (added)
+    {
+        // The buffer lock orders the timestamps of the thread, the flush
+        // orders the ones of all the threads
+        uint64_t timestamp_ns = getMonotonicNs() - capture_start_ns;
+        size_t end = buffer->size + staged_size;
+        for (size_t offset = buffer->size; offset < end;)
+        {
+            zz_event_capture_record_t record;
+            memcpy(&record, buffer->data + offset, sizeof(record));
+            record.timestamp_ns = timestamp_ns;
+            memcpy(buffer->data + offset, &record, sizeof(record));
+            offset += sizeof(record) + record.data_size;
+        }
+        buffer->size = end;
+    }
+    staged_size = 0;
+    bool is_full = buffer->size >= CAPTURE_THREAD_BUFFER_SIZE / 2;
+    pthread_mutex_unlock(&buffer->mtx);
+
+    // The flush takes the locks of all the buffers, so it is done with the
+    // one of this buffer released
+    if (is_full)
+    {
+        flush_capture_buffers();
+    }
+
+    return 0;
+}
+
+int zz_event_capture_scan(
+    const char *path,
+    int32_t *queue_ids,
+    uint32_t max_queues,
+    uint32_t *n_queues,
+    uint64_t *n_events)
+{
+    FILE *file = open_trace(path, NULL);
+    if (file == NULL)
+    {
+        return 1;
+    }
+
+    zz_event_capture_record_t record;
+    void *payload = NULL;
+    uint32_t payload_capacity = 0;
+    uint32_t queue_count = 0;
+    uint64_t event_count = 0;
+    int err = 0;
+
+    while ((err = read_record(file, &record, &payload, &payload_capacity)) == 0)
+    {
+        bool is_new_queue = true;
+        for (uint32_t i = 0; queue_ids && i < queue_count && i < max_queues; i++)
+        {
+            if (queue_ids[i] == record.queue_id)
+            {
+                is_new_queue = false;
+                break;
+            }
+        }
+
+        if (is_new_queue)
+        {
+            if (queue_ids && queue_count < max_queues)
+            {
+                queue_ids[queue_count] = record.queue_id;
+            }
+            queue_count++;
+        }
+        event_count++;
+    }
+
+    free(payload);
+    fclose(file);
+
+    if (n_queues)
+    {
+        *n_queues = queue_count;
+    }
+    if (n_events)
+    {
+        *n_events = event_count;
+    }
+
+    // read_record returns -1 at the end of the file
+    return err < 0 ? 0 : err;
+}
+
+int zz_event_replay(
+    const char *path,
+    double speed,
+    uint64_t *n_events)
+{
+    uint32_t flags = 0;
+    FILE *file = open_trace(path, &flags);
+    if (file == NULL)
+    {
+        return 1;
+    }
+
+    zz_event_capture_record_t record;
+    void *payload = NULL;
+    uint32_t payload_capacity = 0;
+    uint64_t event_count = 0;
+    uint64_t start_ns = getMonotonicNs();
+    int err = 0;
+
+    while ((err = read_record(file, &record, &payload, &payload_capacity)) == 0)
+    {
+        if (speed > 0)
+        {
+            wait_until_ns(start_ns + (uint64_t)((double)record.timestamp_ns / speed));
+        }
+
+        // Only the events accepted by their queue were captured, but the
+        // queues may be in another state now: keep replaying if one fails
+        if (replay_record(&record, payload, flags))
+        {
+            fprintf(stderr, "Unable to replay event %" PRIu64 ".\n", event_count);
+        }
+        event_count++;
+    }
+
+    free(payload);
+    fclose(file);
+
+    if (n_events)
+    {
+        *n_events = event_count;
+    }
+
+    return err < 0 ? 0 : err;
+}
+
+// Private implementations
+void create_capture_buffer_key(void)
+{
+    pthread_key_create(&capture_buffer_key, &mark_capture_buffer_exited);
+}
+
+void mark_capture_buffer_exited(void *data)
+{
+    capture_buffer_t *buffer = data;
+    atomic_store(&buffer->exited, true);
+}
+
+capture_buffer_t *get_capture_buffer(void)
+{
+    pthread_once(&capture_buffer_key_once, &create_capture_buffer_key);
+
+    capture_buffer_t *buffer = calloc(1, sizeof(capture_buffer_t));
+    if (buffer == NULL || reserve_capture_buffer(buffer, CAPTURE_THREAD_BUFFER_SIZE))
+    {
+        free(buffer);
+        fprintf(stderr, "Unable to allocate a capture buffer.\n");
+        return NULL;
+    }
+    pthread_mutex_init(&buffer->mtx, NULL);
+
+    pthread_mutex_lock(&capture_mtx);
+    buffer->next = capture_buffers;
+    capture_buffers = buffer;
+    pthread_mutex_unlock(&capture_mtx);
+
+    pthread_setspecific(capture_buffer_key, buffer);
+    thread_capture_buffer = buffer;
+
+    return buffer;
+}
+
+int reserve_capture_buffer(capture_buffer_t *buffer, size_t size)
+{
+    if (size <= buffer->capacity)
+    {
+        return 0;
+    }
+
+    // Only a batch of events or a large payload does not fit after a flush
+    size_t capacity = buffer->capacity ? buffer->capacity : CAPTURE_THREAD_BUFFER_SIZE;
+    while (capacity < size)
+    {
+        capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL)
+    {
+        return 1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return 0;
+}
+
+void flush_capture_buffers(void)
+{
+    pthread_mutex_lock(&capture_mtx);
+    if (capture_file == NULL)
+    {
+        pthread_mutex_unlock(&capture_mtx);
+        return;
+    }
+
+    // With all the buffers locked, every record committed later has a later
+    // timestamp than the ones written now, so the file stays sorted
+    uint32_t n_buffers = 0;
+    for (capture_buffer_t *buffer = capture_buffers; buffer; buffer = buffer->next)
+    {
+        pthread_mutex_lock(&buffer->mtx);
+        n_buffers++;
+    }
+
+    size_t *offsets = calloc(n_buffers ? n_buffers : 1, sizeof(size_t));
+    if (offsets == NULL)
+    {
+        fprintf(stderr, "Unable to flush the capture, %u buffers lost.\n", n_buffers);
+    }
+
+    // Merge the records of the threads, each buffer is already sorted
+    while (offsets)
+    {
+        capture_buffer_t *next_buffer = NULL;
+        uint32_t next_index = 0;
+        zz_event_capture_record_t next_record;
+        uint32_t i = 0;
+        for (capture_buffer_t *buffer = capture_buffers; buffer; buffer = buffer->next, i++)
+        {
+            if (offsets[i] < buffer->size)
+            {
+                zz_event_capture_record_t record;
+                memcpy(&record, buffer->data + offsets[i], sizeof(record));
+                if (next_buffer == NULL || record.timestamp_ns < next_record.timestamp_ns)
+                {
+                    next_buffer = buffer;
+                    next_index = i;
+                    next_record = record;
+                }
+            }
+        }
+        if (next_buffer == NULL)
+        {
+            break;
+        }
+
+        size_t record_size = sizeof(next_record) + next_record.data_size;
+        fwrite(next_buffer->data + offsets[next_index], record_size, 1, capture_file);
+        offsets[next_index] += record_size;
+    }
+    free(offsets);
+
+    for (capture_buffer_t *buffer = capture_buffers; buffer; buffer = buffer->next)
+    {
+        buffer->size = 0;
+        // Give back the memory taken by a large batch
+        if (buffer->capacity > CAPTURE_THREAD_BUFFER_SIZE)
+        {
+            unsigned char *data = realloc(buffer->data, CAPTURE_THREAD_BUFFER_SIZE);
+            if (data)
+            {
+                buffer->data = data;
+                buffer->capacity = CAPTURE_THREAD_BUFFER_SIZE;
+            }
+        }
+        pthread_mutex_unlock(&buffer->mtx);
+    }
+    pthread_mutex_unlock(&capture_mtx);
+}
+
+void release_exited_capture_buffers(void)
+{
+    // Called with capture_mtx taken, once the buffers are flushed
+    capture_buffer_t **link = &capture_buffers;
+    while (*link)
+    {
+        capture_buffer_t *buffer = *link;
+        if (atomic_load(&buffer->exited))
+        {
+            *link = buffer->next;
+            pthread_mutex_destroy(&buffer->mtx);
+            free(buffer->data);
+            free(buffer);
+            continue;
+        }
+        link = &buffer->next;
+    }
+}
+
+int replay_record(const zz_event_capture_record_t *record, const void *payload, uint32_t flags)
+{
+    if (record->data_type != ZZ_EVENT_DATA_TYPE_BUFFER)
+    {
+        return zz_event_create_event_in_queue(
+            record->queue_id, record->event_type,
+            (zz_event_data_type_t)record->data_type,
+            (void *)payload, record->data_size, NULL);
+    }
+
+    // Without its content, the buffer is replayed zero filled
+    bool has_content = flags & ZZ_EVENT_CAPTURE_FLAG_BUFFER_CONTENT;
+    uint64_t size = record->data_size;
+    if (!has_content && record->data_size == sizeof(size))
+    {
+        memcpy(&size, payload, sizeof(size));
+    }
+
+    zz_event_buffer_t *buffer = NULL;
+    if (zz_event_buffer_alloc(size, 0, &buffer))
+    {
+        return 1;
+    }
+    if (has_content && size)
+    {
+        memcpy(buffer->data, payload, size);
+    }
+    else if (size)
+    {
+        memset(buffer->data, 0, size);
+    }
+
+    return zz_event_post_buffer(record->queue_id, record->event_type, buffer, NULL);
+}
+
+FILE *open_trace(const char *path, uint32_t *flags)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open capture file <%s>. Err: %d\n", path, errno);
+        return NULL;
+    }
+
+    zz_event_capture_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, ZZ_EVENT_CAPTURE_MAGIC, sizeof(header.magic)) ||
+        header.version != ZZ_EVENT_CAPTURE_VERSION)
+    {
+        fprintf(stderr, "Invalid capture file <%s>.\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    if (flags)
+    {
+        *flags = header.flags;
+    }
+
+    return file;
+}
+
+int read_record(
+    FILE *file,
+    zz_event_capture_record_t *record,
+    void **payload,
+    uint32_t *payload_capacity)
+{
+    if (fread(record, sizeof(*record), 1, file) != 1)
+    {
+        return feof(file) ? -1 : 1;
+    }
+
+    if (record->data_size > *payload_capacity)
+    {
+        void *new_payload = realloc(*payload, record->data_size);
+        if (new_payload == NULL)
+        {
+            fprintf(stderr, "Unable to allocate %u bytes for the event payload.\n", record->data_size);
+            return 1;
+        }
+        *payload = new_payload;
+        *payload_capacity = record->data_size;
+    }
+
+    if (record->data_size && fread(*payload, record->data_size, 1, file) != 1)
+    {
+        fprintf(stderr, "Truncated capture file.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+void wait_until_ns(uint64_t deadline_ns)
+{
+    uint64_t now_ns = getMonotonicNs();
+    if (now_ns >= deadline_ns)
+    {
+        return;
+    }
+
+    // Sleeping costs several microseconds, spin for the short gaps instead
+    if (deadline_ns - now_ns < REPLAY_SPIN_THRESHOLD_NS)
+    {
+        while (getMonotonicNs() < deadline_ns)
+        {
+        }
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / 1000000000ULL;
+    ts.tv_nsec = deadline_ns % 1000000000ULL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef __ZZ_EVENT_CAPTURE_H__
+#define __ZZ_EVENT_CAPTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "zz_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Magic bytes at the beginning of every capture file
+#define ZZ_EVENT_CAPTURE_MAGIC "ZZEVTRC1"
+/// Version of the capture file format
+#define ZZ_EVENT_CAPTURE_VERSION 2
+/// The BUFFER events were recorded with their content, otherwise only with 
+/// their size (an uint64_t payload)
+#define ZZ_EVENT_CAPTURE_FLAG_BUFFER_CONTENT 0x1
+
+/**
+ * @brief Header written once at the beginning of a capture file
+ */
+typedef struct zz_event_capture_header_t
+{
+    /// Must be equal to ZZ_EVENT_CAPTURE_MAGIC (not null terminated)
+    char magic[8];
+    /// The capture file format version
+    uint32_t version;
+    /// ZZ_EVENT_CAPTURE_FLAG_* of the capture
+    uint32_t flags;
+} zz_event_capture_header_t;
+
+/**
+ * @brief Header of every captured event. The payload follows it in the file.
+ */
+typedef struct zz_event_capture_record_t
+{
+    /// Nanoseconds elapsed since the capture was started
+    uint64_t timestamp_ns;
+    /// Queue where the event was added
+    int32_t queue_id;
+    /// The event type id
+    uint32_t event_type;
+    /// The data type carried by the event
+    uint32_t data_type;
+    /// Number of payload bytes following this record
+    uint32_t data_size;
+} zz_event_capture_record_t;
+
+/**
+ * @brief Starts recording every event added to any queue
+ *
+ * @param path [in] The trace file to be created. It is truncated if it exists.
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_capture_start(
+    const char *path);
+
+/**
+ * @brief Records the content of the BUFFER events in the next captures
+ *
+ * Disabled by default: a buffer can be up to 4 GiB and its content is copied
+ * when it is posted, so only its size is recorded and the replay posts a 
+ * zero filled buffer of the same size. Enable it to replay the real content.
+ *
+ * @param enabled [in] True to record the content of the buffers
+ */
+void zz_event_capture_set_buffer_content(
+    bool enabled);
+
+/**
+ * @brief Stops the capture and flushes the trace file
+ *
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_capture_stop(void);
+
+/**
+ * @brief Checks if there is a capture running
+ *
+ * @return true if the events are being recorded, false otherwise.
+ */
+bool zz_event_capture_is_active(void);
+
+/**
+ * @brief Stages an event to be captured, before it is added to its queue
+ *
+ * Called by the event module for every event posted to a queue, while the
+ * payload is still owned by the producer. The event is only recorded by the
+ * following zz_event_capture_commit, if its queue accepted it. Several events
+ * added at once can be staged before a single commit. Each thread keeps its
+ * records in its own buffer, written to the file (sorted by time with the
+ * ones of the other threads) when it is full or the capture stops.
+ *
+ * @param queue_id [in] Queue where the event will be added
+ * @param event_type [in] The event type id
+ * @param data_type [in] The data type carried by the data pointer
+ * @param data [in] The event payload
+ * @param data_size [in] The binary size of the payload
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_capture_record(
+    int32_t queue_id,
+    uint32_t event_type,
+    zz_event_data_type_t data_type,
+    const void *data,
+    uint32_t data_size);
+
+/**
+ * @brief Records or discards the events staged by the calling thread
+ *
+ * Must be called after every zz_event_capture_record that returned 0, once
+ * the events were added to their queue (or failed to).
+ *
+ * @param added [in] True if the queue accepted the staged events
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_capture_commit(
+    bool added);
+
+/**
+ * @brief Reads a trace file and lists the queues it uses
+ *
+ * @param path [in] The trace file
+ * @param queue_ids [out] The distinct queue ids found in the trace (optional)
+ * @param max_queues [in] The capacity of queue_ids
+ * @param n_queues [out] The number of distinct queue ids (optional)
+ * @param n_events [out] The number of events in the trace (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_capture_scan(
+    const char *path,
+    int32_t *queue_ids,
+    uint32_t max_queues,
+    uint32_t *n_queues,
+    uint64_t *n_events);
+
+/**
+ * @brief Feeds the events of a trace file back into their queues
+ *
+ * The queues must be created, and their callbacks registered, before the 
+ * replay starts: the replay only posts the events.
+ *
+ * @param path [in] The trace file
+ * @param speed [in] Time scale of the replay. 1.0 keeps the original timing,
+ *              2.0 replays twice as fast and values <= 0 replay without any
+ *              delay between events.
+ * @param n_events [out] The number of events replayed (optional)
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_replay(
+    const char *path,
+    double speed,
+    uint64_t *n_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZZ_EVENT_CAPTURE_H__
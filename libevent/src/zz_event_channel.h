@@ -0,0 +1,92 @@
+#ifndef __ZZ_EVENT_CHANNEL_H__
+#define __ZZ_EVENT_CHANNEL_H__
+
+#include <stddef.h>
+
+#include "zz_event.h"
+
+/**
+ * @brief Declares a typed event channel
+ *
+ * A channel binds an event type of a queue to a payload type, so the payload
+ * size and type are fixed at compile time. For a channel called `name` it
+ * generates:
+ *
+ * - `name_payload_t`: the payload type
+ * - `name_handler_t`: the handler type, `void (name_payload_t *payload)`
+ * - `int name_post(const name_payload_t *payload)`: copies the payload into
+ *   the event and appends it to the queue
+ * - `int name_register(name_handler_t *handler)`: registers the handler as
+ *   the queue callback for the event type
+ * - `name_batch_handler_t`: the batch handler type,
+ *   `void (const name_payload_t *payloads, uint32_t n_payloads)`
+ * - `int name_post_batch(const name_payload_t *payloads, uint32_t n)`: posts
+ *   an event for every payload of the array, in order
+ * - `int name_register_batch(name_batch_handler_t *handler)`: registers the
+ *   handler as the queue batch callback for the event type (replacing the
+ *   handler registered with name_register)
+ *
+ * The handler receives the payload already cast, so it does not need to check
+ * the event data type or size. The payload is stored inline in the event,
+ * hence its alignment can not be greater than the alignment of max_align_t.
+ *
+ * Usage (at file scope, usually in a shared header):
+ * @code
+ * ZZ_EVENT_CHANNEL(get_square, MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_GET_SQUARE, int32_t);
+ * @endcode
+ *
+ * @remark The registered handler is kept per translation unit, so a channel
+ * must be registered in the same source file that implements its handler.
+ *
+ * @param name The channel name, used as prefix of the generated symbols
+ * @param queue_id The queue where the events are posted
+ * @param event_type The event type id of the channel
+ * @param payload_type The type carried by every event of the channel
+ */
+#define ZZ_EVENT_CHANNEL(name, queue_id, event_type, payload_type)                  \
+    typedef payload_type name##_payload_t;                                         \
+    typedef void(name##_handler_t)(name##_payload_t * payload);                    \
+    typedef void(name##_batch_handler_t)(const name##_payload_t *payloads,         \
+                                         uint32_t n_payloads);                     \
+    static name##_handler_t *name##_handler = NULL;                                \
+    static name##_batch_handler_t *name##_batch_handler = NULL;                    \
+    static inline void name##_dispatch(zz_event_list_t *event)                     \
+    {                                                                              \
+        name##_handler((name##_payload_t *)zz_event_data(event));                           \
+    }                                                                              \
+    static inline void name##_dispatch_batch(const zz_event_batch_t *batch,        \
+                                             void *ctx)                            \
+    {                                                                              \
+        (void)ctx;                                                                 \
+        name##_batch_handler((const name##_payload_t *)batch->data,                \
+                             batch->n_events);                                     \
+    }                                                                              \
+    static inline int name##_post(const name##_payload_t *payload)                 \
+    {                                                                              \
+        return zz_event_create_event_in_queue(                                     \
+            (queue_id), (event_type), ZZ_EVENT_DATA_TYPE_STRUCT,                   \
+            (void *)payload, sizeof(name##_payload_t), NULL);                      \
+    }                                                                              \
+    static inline int name##_register(name##_handler_t *handler)                   \
+    {                                                                              \
+        name##_handler = handler;                                                  \
+        return zz_event_register_event_type_callback(                              \
+            (queue_id), (event_type), &name##_dispatch);                           \
+    }                                                                              \
+    static inline int name##_post_batch(const name##_payload_t *payloads,          \
+                                        uint32_t n_payloads)                       \
+    {                                                                              \
+        return zz_event_create_events_in_queue(                                    \
+            (queue_id), (event_type), ZZ_EVENT_DATA_TYPE_STRUCT,                   \
+            payloads, sizeof(name##_payload_t), n_payloads);                       \
+    }                                                                              \
+    static inline int name##_register_batch(name##_batch_handler_t *handler)       \
+    {                                                                              \
+        name##_batch_handler = handler;                                            \
+        return zz_event_register_event_batch_callback(                             \
+            (queue_id), (event_type), &name##_dispatch_batch, NULL);               \
+    }                                                                              \
+    _Static_assert(_Alignof(name##_payload_t) <= _Alignof(max_align_t),            \
+                   #name ": payload alignment greater than max_align_t")
+
+#endif // __ZZ_EVENT_CHANNEL_H__
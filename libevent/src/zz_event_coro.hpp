@@ -0,0 +1,362 @@
+#ifndef __ZZ_EVENT_CORO_HPP__
+#define __ZZ_EVENT_CORO_HPP__
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "zz_event.hpp"
+
+/**
+ * @brief C++20 coroutine integration for the zz_event queues
+ *
+ * A coroutine returning zz::Task can wait for the next event of a type, or
+ * post a request and wait for its reply, without blocking the thread. The
+ * suspended coroutines are resumed from zz_event_process_events, in the
+ * thread consuming the queue where the awaited event arrives, so many
+ * workflows can run concurrently on a single consumer thread.
+ *
+ * @code
+ * zz::Task square_flow(int32_t number)
+ * {
+ *     std::optional<int32_t> square = co_await zz::request<int32_t>(
+ *         MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_GET_SQUARE, number,
+ *         GUI_EVENT_QUEUE, EVENT_GUI_GET_SQUARE_READY);
+ *     ...
+ * }
+ * @endcode
+ *
+ * @remark While a coroutine awaits an event type, the coroutine machinery owns
+ * the callback of that type in that queue: do not register another callback
+ * for it. Awaited events are delivered to the waiters in FIFO order, so the
+ * replies of a request must be posted in the order the requests are handled.
+ */
+namespace zz
+{
+
+/**
+ * @brief Detached coroutine that starts running as soon as it is called
+ *
+ * The coroutine frame is released when the coroutine finishes.
+ */
+class Task
+{
+public:
+    struct promise_type
+    {
+        Task get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+namespace detail
+{
+
+/// A coroutine suspended until an event arrives. Lives in the coroutine frame.
+struct Waiter
+{
+    std::coroutine_handle<> handle;
+    zz_event_list_t *event = nullptr;
+    Waiter *next = nullptr;
+};
+
+/**
+ * @brief FIFO of the coroutines waiting for one event type of one queue
+ *
+ * The list registers itself as the event callback when the first coroutine
+ * waits and removes the callback once it is empty. The lists are never
+ * released: a consumer thread may still be dispatching to a list after its
+ * callback is removed.
+ */
+class WaitList
+{
+public:
+    using Key = std::pair<int32_t, uint32_t>;
+
+    static bool push(int32_t queue_id, uint32_t event_type, Waiter *waiter)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto &list = lists()[Key(queue_id, event_type)];
+        if (!list)
+        {
+            list = std::make_unique<WaitList>(queue_id, event_type);
+        }
+        if (list->head_ == nullptr &&
+            zz_event_register_event_type_ctx_callback(queue_id, event_type, &dispatch, list.get()))
+        {
+            return false;
+        }
+
+        if (list->tail_)
+        {
+            list->tail_->next = waiter;
+        }
+        else
+        {
+            list->head_ = waiter;
+        }
+        list->tail_ = waiter;
+
+        return true;
+    }
+
+    static void remove(int32_t queue_id, uint32_t event_type, Waiter *waiter)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        auto it = lists().find(Key(queue_id, event_type));
+        if (it == lists().end())
+        {
+            return;
+        }
+
+        WaitList &list = *it->second;
+        Waiter *prev = nullptr;
+        for (Waiter *curr = list.head_; curr; prev = curr, curr = curr->next)
+        {
+            if (curr == waiter)
+            {
+                (prev ? prev->next : list.head_) = curr->next;
+                if (list.tail_ == curr)
+                {
+                    list.tail_ = prev;
+                }
+                break;
+            }
+        }
+
+        if (list.head_ == nullptr)
+        {
+            zz_event_remove_event_type_ctx_callback(queue_id, event_type, &dispatch, &list);
+        }
+    }
+
+    WaitList(int32_t queue_id, uint32_t event_type)
+        : queue_id_(queue_id), event_type_(event_type)
+    {
+    }
+
+private:
+    static void dispatch(zz_event_list_t *event, void *ctx)
+    {
+        Waiter *waiter = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            auto *self = static_cast<WaitList *>(ctx);
+            waiter = self->head_;
+            if (waiter == nullptr)
+            {
+                // Dispatched with the routes from before the last waiter left
+                return;
+            }
+            self->head_ = waiter->next;
+            if (self->head_ == nullptr)
+            {
+                self->tail_ = nullptr;
+                zz_event_remove_event_type_ctx_callback(self->queue_id_, self->event_type_, &dispatch, self);
+            }
+        }
+
+        // Resume outside the lock, the coroutine may wait again right away
+        waiter->event = event;
+        waiter->handle.resume();
+    }
+
+    static std::mutex &mutex()
+    {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    static std::map<Key, std::unique_ptr<WaitList>> &lists()
+    {
+        static std::map<Key, std::unique_ptr<WaitList>> wait_lists;
+        return wait_lists;
+    }
+
+    int32_t queue_id_;
+    uint32_t event_type_;
+    Waiter *head_ = nullptr;
+    Waiter *tail_ = nullptr;
+};
+
+} // namespace detail
+
+/**
+ * @brief Awaitable resumed with the next event of a type in a queue
+ *
+ * co_await returns the event, which is valid until the coroutine suspends
+ * again or returns.
+ */
+class NextEvent
+{
+public:
+    NextEvent(int32_t queue_id, uint32_t event_type)
+        : queue_id_(queue_id), event_type_(event_type)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        waiter_.handle = handle;
+        return detail::WaitList::push(queue_id_, event_type_, &waiter_);
+    }
+
+    /// The awaited event or nullptr if the wait could not be registered
+    zz_event_list_t *await_resume() const noexcept
+    {
+        return waiter_.event;
+    }
+
+    /// Stops waiting, for awaiters that decide not to suspend after all
+    void cancel()
+    {
+        detail::WaitList::remove(queue_id_, event_type_, &waiter_);
+    }
+
+private:
+    int32_t queue_id_;
+    uint32_t event_type_;
+    detail::Waiter waiter_;
+};
+
+/**
+ * @brief Awaitable resumed with the payload of the next event of a type
+ *
+ * co_await returns the payload moved out of the event, or std::nullopt if
+ * the wait could not be registered or the event does not carry a T.
+ */
+template <typename T>
+class NextPayload : public NextEvent
+{
+public:
+    using NextEvent::NextEvent;
+
+    std::optional<T> await_resume() const
+    {
+        zz_event_list_t *event = NextEvent::await_resume();
+        T *data = event ? payload<T>(event) : nullptr;
+        if (data == nullptr)
+        {
+            return std::nullopt;
+        }
+        return std::optional<T>(std::move(*data));
+    }
+};
+
+/**
+ * @brief Awaitable that posts a request and is resumed with its reply
+ *
+ * The waiter is registered before the request is posted, so the reply can
+ * not be missed even if it is processed by another thread.
+ */
+template <typename R, typename Req>
+class Request
+{
+public:
+    Request(int32_t queue_id, uint32_t event_type, Req &&payload,
+            int32_t reply_queue_id, uint32_t reply_event_type)
+        : queue_id_(queue_id), event_type_(event_type), payload_(std::move(payload)),
+          reply_(reply_queue_id, reply_event_type)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        if (!reply_.await_suspend(handle))
+        {
+            return false;
+        }
+
+        if (zz::post(queue_id_, event_type_, std::move(payload_)))
+        {
+            reply_.cancel();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// The reply payload or std::nullopt if the request could not be posted
+    std::optional<R> await_resume() const
+    {
+        return reply_.await_resume();
+    }
+
+private:
+    int32_t queue_id_;
+    uint32_t event_type_;
+    Req payload_;
+    NextPayload<R> reply_;
+};
+
+/// Waits for the next event of a type in a queue
+inline NextEvent next_event(int32_t queue_id, uint32_t event_type)
+{
+    return NextEvent(queue_id, event_type);
+}
+
+/// Waits for the next event of a type in a queue and returns its payload
+template <typename T>
+NextPayload<T> next(int32_t queue_id, uint32_t event_type)
+{
+    return NextPayload<T>(queue_id, event_type);
+}
+
+/**
+ * @brief Posts a request and waits for the reply
+ *
+ * @tparam R The payload type of the reply
+ * @param queue_id [in] Queue where the request is posted
+ * @param event_type [in] The event type of the request
+ * @param payload [in] The request payload, moved into the event
+ * @param reply_queue_id [in] Queue where the reply is expected
+ * @param reply_event_type [in] The event type of the reply
+ */
+template <typename R, typename Req>
+Request<R, std::decay_t<Req>> request(int32_t queue_id, uint32_t event_type, Req &&payload,
+                                      int32_t reply_queue_id, uint32_t reply_event_type)
+{
+    return Request<R, std::decay_t<Req>>(queue_id, event_type, std::decay_t<Req>(std::forward<Req>(payload)),
+                                         reply_queue_id, reply_event_type);
+}
+
+} // namespace zz
+
+#endif // __ZZ_EVENT_CORO_HPP__
@@ -0,0 +1,500 @@
+#include "zz_event_route.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Private prototypes
+bool pattern_matches(
+    zz_event_match_t match,
+    uint32_t pattern_type,
+    uint32_t pattern_type_last,
+    uint32_t pattern_type_mask,
+    uint32_t event_type);
+
+uint32_t route_hash(
+    uint32_t event_type);
+
+const zz_event_route_t *find_wildcard_route(
+    const zz_event_route_table_t *table,
+    uint32_t event_type);
+
+zz_event_route_t *resolve_wildcard_route(
+    const zz_event_route_table_t *table,
+    uint32_t event_type);
+
+uint32_t fill_route(
+    zz_event_route_t *route,
+    uint32_t event_type,
+    const zz_event_callback_list_t *callback_list,
+    zz_event_route_handler_t *handlers);
+
+zz_event_route_handler_t route_handler(
+    const zz_event_callback_list_t *callback);
+
+void call_handler(
+    const zz_event_route_handler_t *handler,
+    zz_event_list_t *event);
+
+void call_batch_handler(
+    const zz_event_route_handler_t *handler,
+    zz_event_list_t *const *events,
+    uint32_t n_events);
+
+// Public implementation
+bool zz_event_route_matches(
+    const zz_event_callback_list_t *callback,
+    uint32_t event_type)
+{
+    return pattern_matches(
+        callback->match, callback->event_type, callback->event_type_last,
+        callback->event_type_mask, event_type);
+}
+
+int zz_event_route_build(
+    const zz_event_callback_list_t *callback_list,
+    zz_event_route_table_t **table)
+{
+    *table = NULL;
+    if (callback_list == NULL)
+    {
+        return 0;
+    }
+
+    // Count the storage needed by every route
+    uint32_t n_sparse = 0;
+    uint32_t n_wildcards = 0;
+    uint32_t n_handlers = 0;
+    for (const zz_event_callback_list_t *curr_item = callback_list; curr_item; curr_item = curr_item->next)
+    {
+        if (curr_item->match != ZZ_EVENT_MATCH_EXACT)
+        {
+            n_wildcards++;
+        }
+        else if (curr_item->event_type >= ZZ_EVENT_ROUTE_DENSE_SIZE)
+        {
+            n_sparse++;
+            n_handlers += fill_route(NULL, curr_item->event_type, callback_list, NULL);
+        }
+    }
+    for (uint32_t event_type = 0; event_type < ZZ_EVENT_ROUTE_DENSE_SIZE; event_type++)
+    {
+        n_handlers += fill_route(NULL, event_type, callback_list, NULL);
+    }
+    uint32_t n_batch_routes = 0;
+    for (const zz_event_callback_list_t *curr_item = callback_list; curr_item; curr_item = curr_item->next)
+    {
+        if (curr_item->match == ZZ_EVENT_MATCH_EXACT && curr_item->batch_callback &&
+            curr_item->callback == NULL && curr_item->ctx_callback == NULL)
+        {
+            n_batch_routes++;
+        }
+    }
+
+    zz_event_route_table_t *new_table = calloc(1, sizeof(zz_event_route_table_t));
+    if (new_table == NULL)
+    {
+        fprintf(stderr, "Unable to allocate the routing table.\n");
+        return 1;
+    }
+
+    uint32_t sparse_size = 0;
+    if (n_sparse)
+    {
+        // Keep the load factor at or below 0.5
+        sparse_size = 1;
+        while (sparse_size < n_sparse * 2)
+        {
+            sparse_size <<= 1;
+        }
+        new_table->sparse = calloc(sparse_size, sizeof(zz_event_route_t));
+        new_table->sparse_mask = sparse_size - 1;
+    }
+    if (n_wildcards)
+    {
+        new_table->wildcards = calloc(n_wildcards, sizeof(zz_event_route_wildcard_t));
+        new_table->wildcard_cache = calloc(ZZ_EVENT_ROUTE_CACHE_SIZE, sizeof(_Atomic(zz_event_route_t *)));
+    }
+    if (n_handlers)
+    {
+        new_table->handler_pool = calloc(n_handlers, sizeof(zz_event_route_handler_t));
+    }
+
+    if ((n_sparse && new_table->sparse == NULL) ||
+        (n_wildcards && (new_table->wildcards == NULL || new_table->wildcard_cache == NULL)) ||
+        (n_handlers && new_table->handler_pool == NULL))
+    {
+        zz_event_route_free(new_table);
+        fprintf(stderr, "Unable to allocate the routing table.\n");
+        return 1;
+    }
+
+    // Resolve the routes
+    new_table->n_batch_routes = n_batch_routes;
+    zz_event_route_handler_t *handlers = new_table->handler_pool;
+    for (uint32_t event_type = 0; event_type < ZZ_EVENT_ROUTE_DENSE_SIZE; event_type++)
+    {
+        handlers += fill_route(&new_table->dense[event_type], event_type, callback_list, handlers);
+    }
+
+    for (const zz_event_callback_list_t *curr_item = callback_list; curr_item; curr_item = curr_item->next)
+    {
+        if (curr_item->match != ZZ_EVENT_MATCH_EXACT)
+        {
+            zz_event_route_wildcard_t *wildcard = &new_table->wildcards[new_table->n_wildcards++];
+            wildcard->match = curr_item->match;
+            wildcard->event_type = curr_item->event_type;
+            wildcard->event_type_last = curr_item->event_type_last;
+            wildcard->event_type_mask = curr_item->event_type_mask;
+            wildcard->handler = route_handler(curr_item);
+        }
+        else if (curr_item->event_type >= ZZ_EVENT_ROUTE_DENSE_SIZE)
+        {
+            uint32_t slot = route_hash(curr_item->event_type) & new_table->sparse_mask;
+            while (new_table->sparse[slot].n_handlers)
+            {
+                slot = (slot + 1) & new_table->sparse_mask;
+            }
+            handlers += fill_route(&new_table->sparse[slot], curr_item->event_type, callback_list, handlers);
+        }
+    }
+
+    *table = new_table;
+
+    return 0;
+}
+
+void zz_event_route_free(
+    zz_event_route_table_t *table)
+{
+    if (table)
+    {
+        if (table->wildcard_cache)
+        {
+            for (uint32_t i = 0; i < ZZ_EVENT_ROUTE_CACHE_SIZE; i++)
+            {
+                free(atomic_load(&table->wildcard_cache[i]));
+            }
+            free(table->wildcard_cache);
+        }
+        free(table->sparse);
+        free(table->wildcards);
+        free(table->handler_pool);
+        free(table);
+    }
+}
+
+const zz_event_route_t *zz_event_route_find(
+    const zz_event_route_table_t *table,
+    uint32_t event_type)
+{
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    if (event_type < ZZ_EVENT_ROUTE_DENSE_SIZE)
+    {
+        return &table->dense[event_type];
+    }
+    if (table->sparse)
+    {
+        uint32_t slot = route_hash(event_type) & table->sparse_mask;
+        while (table->sparse[slot].n_handlers)
+        {
+            if (table->sparse[slot].event_type == event_type)
+            {
+                return &table->sparse[slot];
+            }
+            slot = (slot + 1) & table->sparse_mask;
+        }
+    }
+
+    return NULL;
+}
+
+bool zz_event_route_is_batch(
+    const zz_event_route_t *route)
+{
+    // The exact callback is always the first handler
+    return route && route->n_handlers && route->handlers[0].batch_callback &&
+           route->handlers[0].callback == NULL && route->handlers[0].ctx_callback == NULL;
+}
+
+void zz_event_route_dispatch_batch(
+    const zz_event_route_t *route,
+    zz_event_list_t *const *events,
+    uint32_t n_events)
+{
+    call_batch_handler(&route->handlers[0], events, n_events);
+
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        for (uint32_t j = 1; j < route->n_handlers; j++)
+        {
+            call_handler(&route->handlers[j], events[i]);
+        }
+    }
+}
+
+uint32_t zz_event_route_dispatch(
+    const zz_event_route_table_t *table,
+    zz_event_list_t *event)
+{
+    if (table == NULL)
+    {
+        return 0;
+    }
+
+    uint32_t event_type = event->event_type;
+    const zz_event_route_t *route = zz_event_route_find(table, event_type);
+    if (route == NULL && table->n_wildcards)
+    {
+        route = find_wildcard_route(table, event_type);
+    }
+    if (route)
+    {
+        for (uint32_t i = 0; i < route->n_handlers; i++)
+        {
+            call_handler(&route->handlers[i], event);
+        }
+        return route->n_handlers;
+    }
+
+    // Not in the cache (full or out of memory): only the wildcards can match
+    uint32_t n_called = 0;
+    for (uint32_t i = 0; i < table->n_wildcards; i++)
+    {
+        const zz_event_route_wildcard_t *wildcard = &table->wildcards[i];
+        if (pattern_matches(wildcard->match, wildcard->event_type, wildcard->event_type_last,
+                            wildcard->event_type_mask, event_type))
+        {
+            call_handler(&wildcard->handler, event);
+            n_called++;
+        }
+    }
+
+    return n_called;
+}
+
+// Private implementations
+bool pattern_matches(
+    zz_event_match_t match,
+    uint32_t pattern_type,
+    uint32_t pattern_type_last,
+    uint32_t pattern_type_mask,
+    uint32_t event_type)
+{
+    switch (match)
+    {
+    case ZZ_EVENT_MATCH_EXACT:
+        return event_type == pattern_type;
+    case ZZ_EVENT_MATCH_RANGE:
+        return event_type >= pattern_type && event_type <= pattern_type_last;
+    case ZZ_EVENT_MATCH_MASK:
+        return (event_type & pattern_type_mask) == pattern_type;
+    }
+
+    return false;
+}
+
+const zz_event_route_t *find_wildcard_route(const zz_event_route_table_t *table, uint32_t event_type)
+{
+    uint32_t hash = route_hash(event_type);
+    for (uint32_t i = 0; i < ZZ_EVENT_ROUTE_CACHE_PROBES; i++)
+    {
+        _Atomic(zz_event_route_t *) *slot = &table->wildcard_cache[(hash + i) & (ZZ_EVENT_ROUTE_CACHE_SIZE - 1)];
+        zz_event_route_t *route = atomic_load_explicit(slot, memory_order_acquire);
+        if (route == NULL)
+        {
+            zz_event_route_t *new_route = resolve_wildcard_route(table, event_type);
+            if (new_route == NULL)
+            {
+                return NULL;
+            }
+            if (atomic_compare_exchange_strong_explicit(slot, &route, new_route,
+                                                        memory_order_acq_rel, memory_order_acquire))
+            {
+                return new_route;
+            }
+            // Another thread filled the slot first, route is its entry
+            free(new_route);
+        }
+        if (route->event_type == event_type)
+        {
+            return route;
+        }
+    }
+
+    return NULL;
+}
+
+zz_event_route_t *resolve_wildcard_route(const zz_event_route_table_t *table, uint32_t event_type)
+{
+    uint32_t n_handlers = 0;
+    for (uint32_t i = 0; i < table->n_wildcards; i++)
+    {
+        const zz_event_route_wildcard_t *wildcard = &table->wildcards[i];
+        if (pattern_matches(wildcard->match, wildcard->event_type, wildcard->event_type_last,
+                            wildcard->event_type_mask, event_type))
+        {
+            n_handlers++;
+        }
+    }
+
+    // The handlers follow the route in the same allocation. Event types with
+    // no match are cached too, with no handlers.
+    zz_event_route_t *route = malloc(sizeof(zz_event_route_t) + n_handlers * sizeof(zz_event_route_handler_t));
+    if (route == NULL)
+    {
+        return NULL;
+    }
+    route->event_type = event_type;
+    route->n_handlers = n_handlers;
+    route->handlers = n_handlers ? (zz_event_route_handler_t *)(route + 1) : NULL;
+
+    n_handlers = 0;
+    for (uint32_t i = 0; i < table->n_wildcards; i++)
+    {
+        const zz_event_route_wildcard_t *wildcard = &table->wildcards[i];
+        if (pattern_matches(wildcard->match, wildcard->event_type, wildcard->event_type_last,
+                            wildcard->event_type_mask, event_type))
+        {
+            route->handlers[n_handlers++] = wildcard->handler;
+        }
+    }
+
+    return route;
+}
+
+uint32_t route_hash(uint32_t event_type)
+{
+    // Murmur3 finalizer, spreads consecutive event types over the low bits
+    event_type ^= event_type >> 16;
+    event_type *= 0x85ebca6bu;
+    event_type ^= event_type >> 13;
+    event_type *= 0xc2b2ae35u;
+    event_type ^= event_type >> 16;
+
+    return event_type;
+}
+
+uint32_t fill_route(
+    zz_event_route_t *route,
+    uint32_t event_type,
+    const zz_event_callback_list_t *callback_list,
+    zz_event_route_handler_t *handlers)
+{
+    uint32_t n_handlers = 0;
+
+    // The exact callback goes first
+    for (const zz_event_callback_list_t *curr_item = callback_list; curr_item; curr_item = curr_item->next)
+    {
+        if (curr_item->match == ZZ_EVENT_MATCH_EXACT && curr_item->event_type == event_type)
+        {
+            if (handlers)
+            {
+                handlers[n_handlers] = route_handler(curr_item);
+            }
+            n_handlers++;
+            break;
+        }
+    }
+
+    for (const zz_event_callback_list_t *curr_item = callback_list; curr_item; curr_item = curr_item->next)
+    {
+        if (curr_item->match != ZZ_EVENT_MATCH_EXACT && zz_event_route_matches(curr_item, event_type))
+        {
+            if (handlers)
+            {
+                handlers[n_handlers] = route_handler(curr_item);
+            }
+            n_handlers++;
+        }
+    }
+
+    if (route)
+    {
+        route->event_type = event_type;
+        route->n_handlers = n_handlers;
+        route->handlers = n_handlers ? handlers : NULL;
+    }
+
+    return n_handlers;
+}
+
+zz_event_route_handler_t route_handler(const zz_event_callback_list_t *callback)
+{
+    zz_event_route_handler_t handler;
+    handler.callback = callback->callback;
+    handler.ctx_callback = callback->ctx_callback;
+    handler.batch_callback = callback->batch_callback;
+    handler.ctx = callback->ctx;
+
+    return handler;
+}
+
+void call_handler(const zz_event_route_handler_t *handler, zz_event_list_t *event)
+{
+    if (handler->callback)
+    {
+        handler->callback(event);
+    }
+    else if (handler->ctx_callback)
+    {
+        handler->ctx_callback(event, handler->ctx);
+    }
+    else if (handler->batch_callback)
+    {
+        call_batch_handler(handler, &event, 1);
+    }
+}
+
+void call_batch_handler(
+    const zz_event_route_handler_t *handler,
+    zz_event_list_t *const *events,
+    uint32_t n_events)
+{
+    zz_event_batch_t batch;
+    batch.event_type = events[0]->event_type;
+    batch.data_type = (zz_event_data_type_t)events[0]->data_type;
+    batch.data_size = events[0]->data_size;
+    batch.n_events = n_events;
+    batch.data = zz_event_data(events[0]);
+
+    if (n_events == 1)
+    {
+        // A single payload is already in place
+        handler->batch_callback(&batch, handler->ctx);
+        return;
+    }
+
+    // Pack the payloads, keeping max_align_t alignment for the first one
+    _Alignas(max_align_t) unsigned char stack_data[ZZ_EVENT_ROUTE_BATCH_STACK_SIZE];
+    size_t total_size = (size_t)batch.data_size * n_events;
+    unsigned char *data = total_size <= sizeof(stack_data) ? stack_data : malloc(total_size);
+    if (data == NULL)
+    {
+        // Degrade to one event per call rather than dropping the batch
+        fprintf(stderr, "Unable to allocate a batch of %u events, dispatching them one by one.\n", n_events);
+        for (uint32_t i = 0; i < n_events; i++)
+        {
+            call_batch_handler(handler, &events[i], 1);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < n_events; i++)
+    {
+        memcpy(data + (size_t)i * batch.data_size, zz_event_data(events[i]), batch.data_size);
+    }
+    batch.data = data;
+    handler->batch_callback(&batch, handler->ctx);
+
+    if (data != stack_data)
+    {
+        free(data);
+    }
+}
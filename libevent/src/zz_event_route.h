@@ -0,0 +1,184 @@
+#ifndef __ZZ_EVENT_ROUTE_H__
+#define __ZZ_EVENT_ROUTE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "zz_event.h"
+
+/**
+ * Routing table of a queue, used internally by the event module.
+ *
+ * The table is rebuilt from the callback list every time a callback is
+ * registered or removed. It resolves, for every event type, the exact
+ * callback and all the wildcard callbacks matching it, so dispatching an
+ * event costs a single lookup regardless of the number of wildcard callbacks.
+ * The routes of the other event types are resolved from the wildcards on
+ * their first event and cached in the table.
+ */
+
+/// Event types below this value are resolved by direct indexing
+#define ZZ_EVENT_ROUTE_DENSE_SIZE 256
+
+/// Routes of the event types only matched by wildcards cached by a table,
+/// resolved on the first event of every type (must be a power of two)
+#define ZZ_EVENT_ROUTE_CACHE_SIZE 1024
+
+/// Slots looked at for an event type in the cache before giving up on it
+#define ZZ_EVENT_ROUTE_CACHE_PROBES 8
+
+/// Batches with payloads up to this size are packed on the stack
+#define ZZ_EVENT_ROUTE_BATCH_STACK_SIZE 4096
+
+/**
+ * @brief A callback resolved for an event type
+ */
+typedef struct zz_event_route_handler_t
+{
+    /// The callback to process the event
+    zz_event_callback *callback;
+    /// The callback to process the event with a context (used if callback is NULL)
+    zz_event_ctx_callback *ctx_callback;
+    /// The callback to process the events in batches (used if callback and
+    /// ctx_callback are NULL)
+    zz_event_batch_callback *batch_callback;
+    /// The context given to ctx_callback or batch_callback
+    void *ctx;
+} zz_event_route_handler_t;
+
+/**
+ * @brief All the callbacks resolved for one event type
+ */
+typedef struct zz_event_route_t
+{
+    /// The event type of this route
+    uint32_t event_type;
+    /// Number of handlers, 0 if the event type has no callback
+    uint32_t n_handlers;
+    /// The handlers, the exact callback first and then the wildcards
+    zz_event_route_handler_t *handlers;
+} zz_event_route_t;
+
+/**
+ * @brief A wildcard callback kept for the event types outside the table
+ */
+typedef struct zz_event_route_wildcard_t
+{
+    /// The match pattern of the callback
+    zz_event_match_t match;
+    /// First event type of the range or value of the mask pattern
+    uint32_t event_type;
+    /// Last event type of the range
+    uint32_t event_type_last;
+    /// Mask of the mask pattern
+    uint32_t event_type_mask;
+    /// The callback
+    zz_event_route_handler_t handler;
+} zz_event_route_wildcard_t;
+
+/**
+ * @brief The routing table of a queue
+ */
+typedef struct zz_event_route_table_t zz_event_route_table_t;
+struct zz_event_route_table_t
+{
+    /// Routes of the event types below ZZ_EVENT_ROUTE_DENSE_SIZE
+    zz_event_route_t dense[ZZ_EVENT_ROUTE_DENSE_SIZE];
+    /// Open addressing table with the routes of the other event types that
+    /// have an exact callback
+    zz_event_route_t *sparse;
+    /// Capacity of the sparse table minus one (capacity is a power of two)
+    uint32_t sparse_mask;
+    /// Wildcards for the event types that are not in the dense or sparse tables
+    zz_event_route_wildcard_t *wildcards;
+    /// Number of wildcards
+    uint32_t n_wildcards;
+    /// Open addressing cache of the routes resolved from the wildcards, only
+    /// if there are wildcards. Slots are filled once, without locking, by
+    /// the threads dispatching with the table and released with it.
+    _Atomic(zz_event_route_t *) *wildcard_cache;
+    /// Storage of all the route handlers
+    zz_event_route_handler_t *handler_pool;
+    /// Number of routes with a batch callback
+    uint32_t n_batch_routes;
+    /// Next replaced table waiting to be released
+    zz_event_route_table_t *retired_next;
+};
+
+/**
+ * @brief Checks if a callback pattern matches an event type
+ *
+ * @param callback [in] The registered callback
+ * @param event_type [in] The event type
+ * @return true if the callback must receive the events of this type
+ */
+bool zz_event_route_matches(
+    const zz_event_callback_list_t *callback,
+    uint32_t event_type);
+
+/**
+ * @brief Builds the routing table for a callback list
+ *
+ * @param callback_list [in] The callbacks registered in the queue
+ * @param table [out] The new table, NULL if there are no callbacks
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_route_build(
+    const zz_event_callback_list_t *callback_list,
+    zz_event_route_table_t **table);
+
+/**
+ * @brief Releases a routing table
+ *
+ * @param table [in] The table to release (can be NULL)
+ */
+void zz_event_route_free(
+    zz_event_route_table_t *table);
+
+/**
+ * @brief Finds the route resolved for an event type
+ *
+ * @param table [in] The routing table of the queue (can be NULL)
+ * @param event_type [in] The event type
+ * @return The route, NULL if the event type is only matched by wildcards
+ */
+const zz_event_route_t *zz_event_route_find(
+    const zz_event_route_table_t *table,
+    uint32_t event_type);
+
+/**
+ * @brief Checks if the events of a route are dispatched in batches
+ *
+ * @param route [in] The route (can be NULL)
+ * @return true if the exact callback of the route is a batch callback
+ */
+bool zz_event_route_is_batch(
+    const zz_event_route_t *route);
+
+/**
+ * @brief Calls all the callbacks routed for consecutive events of a type
+ *
+ * The batch callback receives the payloads of all the events packed in an
+ * array, then the wildcard callbacks are called for every event.
+ *
+ * @param route [in] The route of the event type, with a batch callback
+ * @param events [in] The events, all of the same type and payload size
+ * @param n_events [in] Number of events, up to ZZ_EVENT_BATCH_MAX_EVENTS
+ */
+void zz_event_route_dispatch_batch(
+    const zz_event_route_t *route,
+    zz_event_list_t *const *events,
+    uint32_t n_events);
+
+/**
+ * @brief Calls all the callbacks routed for an event
+ *
+ * @param table [in] The routing table of the queue (can be NULL)
+ * @param event [in] The event to dispatch
+ * @return uint32_t The number of callbacks called
+ */
+uint32_t zz_event_route_dispatch(
+    const zz_event_route_table_t *table,
+    zz_event_list_t *event);
+
+#endif // __ZZ_EVENT_ROUTE_H__
@@ -0,0 +1,623 @@
+#include "zz_event_runtime.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+/// Scheduling state of an attached queue
+typedef enum actor_state_t
+{
+    /// No pending work, not in the run queue
+    ACTOR_IDLE = 0,
+    /// Waiting in the run queue for a free worker
+    ACTOR_SCHEDULED = 1,
+    /// A worker is processing the queue
+    ACTOR_RUNNING = 2,
+    /// A worker is processing the queue and more events were added meanwhile
+    ACTOR_RUNNING_NOTIFIED = 3,
+} actor_state_t;
+
+/**
+ * @brief A queue attached to the runtime
+ */
+typedef struct runtime_actor_t runtime_actor_t;
+struct runtime_actor_t
+{
+    /// The attached queue
+    int32_t queue_id;
+    /// One of actor_state_t
+    atomic_int state;
+    /// Set when the queue is detached, the workers skip it from then on
+    bool detached;
+    /// Next actor in the run queue
+    runtime_actor_t *run_next;
+    /// Next attached actor
+    runtime_actor_t *next;
+};
+
+static pthread_mutex_t runtime_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/// Signaled when an actor is added to the run queue or the runtime stops
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+
+/// Signaled when a worker finishes a turn and there is nothing left to run
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t *workers = NULL;
+
+/// Schedules the queues with urgent events, which do not call the ready
+/// callback (they can be posted from a signal handler)
+static pthread_t urgent_waker;
+
+static bool has_urgent_waker = false;
+
+/// Posted by the attached queues when an urgent event is added. Initialized
+/// once and never destroyed, a signal handler may post it at any time.
+static sem_t urgent_sem;
+
+static pthread_once_t urgent_sem_once = PTHREAD_ONCE_INIT;
+
+static uint32_t n_workers = 0;
+
+static uint32_t events_per_turn = ZZ_EVENT_RUNTIME_DEFAULT_EVENTS_PER_TURN;
+
+static bool running = false;
+
+static bool stopping = false;
+
+/// Workers in the middle of a turn
+static uint32_t n_busy = 0;
+
+/// Incremented every time the workers become idle
+static uint64_t idle_generation = 0;
+
+/// FIFO of the actors waiting for a worker
+static runtime_actor_t *run_head = NULL;
+
+static runtime_actor_t *run_tail = NULL;
+
+/// All the attached actors
+static runtime_actor_t *actors = NULL;
+
+static atomic_uint_fast64_t n_processed = 0;
+
+// Private prototypes
+void *worker_loop(
+    void *data);
+
+void *urgent_waker_loop(
+    void *data);
+
+void init_urgent_sem(void);
+
+uint32_t get_attached_queue_ids(
+    int32_t *queue_ids);
+
+uint32_t filter_urgent_queue_ids(
+    int32_t *queue_ids,
+    uint32_t n_queues);
+
+void schedule_actor(
+    int32_t queue_id,
+    void *ctx);
+
+bool mark_actor_ready(
+    runtime_actor_t *actor);
+
+void push_actor(
+    runtime_actor_t *actor);
+
+runtime_actor_t *pop_actor(void);
+
+void finish_turn(
+    runtime_actor_t *actor,
+    uint32_t n_remaining);
+
+runtime_actor_t *unlink_actor(
+    int32_t queue_id);
+
+// Public implementation
+int zz_event_runtime_start(
+    uint32_t n_threads,
+    uint32_t max_events_per_turn)
+{
+    if (n_threads == 0)
+    {
+        fprintf(stderr, "The runtime needs at least one worker.\n");
+        return 1;
+    }
+
+    pthread_mutex_lock(&runtime_mtx);
+    if (running)
+    {
+        pthread_mutex_unlock(&runtime_mtx);
+        fprintf(stderr, "The runtime is already running.\n");
+        return 1;
+    }
+
+    workers = calloc(n_threads, sizeof(pthread_t));
+    if (workers == NULL)
+    {
+        pthread_mutex_unlock(&runtime_mtx);
+        fprintf(stderr, "Unable to allocate %u runtime workers.\n", n_threads);
+        return 1;
+    }
+
+    events_per_turn = max_events_per_turn ? max_events_per_turn : ZZ_EVENT_RUNTIME_DEFAULT_EVENTS_PER_TURN;
+    stopping = false;
+    atomic_store(&n_processed, 0);
+    pthread_once(&urgent_sem_once, &init_urgent_sem);
+
+    int err = 0;
+    for (n_workers = 0; n_workers < n_threads; n_workers++)
+    {
+        if ((err = pthread_create(&workers[n_workers], NULL, &worker_loop, NULL)))
+        {
+            fprintf(stderr, "Unable to create runtime worker. Err: %d\n", err);
+            break;
+        }
+    }
+    if (err == 0)
+    {
+        if ((err = pthread_create(&urgent_waker, NULL, &urgent_waker_loop, NULL)))
+        {
+            fprintf(stderr, "Unable to create the runtime urgent waker. Err: %d\n", err);
+        }
+        has_urgent_waker = err == 0;
+    }
+    running = true;
+    pthread_mutex_unlock(&runtime_mtx);
+
+    if (err)
+    {
+        zz_event_runtime_stop();
+        return 1;
+    }
+
+    return 0;
+}
+
+int zz_event_runtime_stop(void)
+{
+    pthread_mutex_lock(&runtime_mtx);
+    if (!running)
+    {
+        pthread_mutex_unlock(&runtime_mtx);
+        return 1;
+    }
+    stopping = true;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&runtime_mtx);
+
+    for (uint32_t i = 0; i < n_workers; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    if (has_urgent_waker)
+    {
+        sem_post(&urgent_sem);
+        pthread_join(urgent_waker, NULL);
+        has_urgent_waker = false;
+    }
+
+    // Stop the notifications first, a producer may still be scheduling an
+    // actor, and then release the actors (no worker is left to run them)
+    pthread_mutex_lock(&runtime_mtx);
+    runtime_actor_t *curr_actor = actors;
+    actors = NULL;
+    pthread_mutex_unlock(&runtime_mtx);
+
+    for (runtime_actor_t *item = curr_actor; item; item = item->next)
+    {
+        zz_event_set_queue_ready_callback(item->queue_id, NULL, NULL);
+        zz_event_set_queue_urgent_semaphore(item->queue_id, NULL);
+    }
+
+    pthread_mutex_lock(&runtime_mtx);
+    run_head = NULL;
+    run_tail = NULL;
+    free(workers);
+    workers = NULL;
+    n_workers = 0;
+    running = false;
+    pthread_mutex_unlock(&runtime_mtx);
+
+    while (curr_actor)
+    {
+        runtime_actor_t *next_actor = curr_actor->next;
+        free(curr_actor);
+        curr_actor = next_actor;
+    }
+
+    return 0;
+}
+
+bool zz_event_runtime_is_running(void)
+{
+    pthread_mutex_lock(&runtime_mtx);
+    bool is_running = running && !stopping;
+    pthread_mutex_unlock(&runtime_mtx);
+
+    return is_running;
+}
+
+int zz_event_runtime_attach(
+    int32_t queue_id)
+{
+    runtime_actor_t *actor = calloc(1, sizeof(runtime_actor_t));
+    if (actor == NULL)
+    {
+        fprintf(stderr, "Unable to allocate the runtime state of queue <%d>.\n", queue_id);
+        return 1;
+    }
+    actor->queue_id = queue_id;
+    atomic_init(&actor->state, ACTOR_IDLE);
+
+    pthread_mutex_lock(&runtime_mtx);
+    if (!running || stopping)
+    {
+        pthread_mutex_unlock(&runtime_mtx);
+        free(actor);
+        fprintf(stderr, "The runtime is not running.\n");
+        return 1;
+    }
+    for (runtime_actor_t *curr_actor = actors; curr_actor; curr_actor = curr_actor->next)
+    {
+        if (curr_actor->queue_id == queue_id)
+        {
+            pthread_mutex_unlock(&runtime_mtx);
+            free(actor);
+            fprintf(stderr, "Queue <%d> is already attached to the runtime.\n", queue_id);
+            return 1;
+        }
+    }
+    actor->next = actors;
+    actors = actor;
+    pthread_mutex_unlock(&runtime_mtx);
+
+    // Called out of the runtime lock, the notifications take the queue lock
+    // first and then the runtime lock
+    if (zz_event_set_queue_ready_callback(queue_id, &schedule_actor, actor))
+    {
+        free(unlink_actor(queue_id));
+        return 1;
+    }
+    zz_event_set_queue_urgent_semaphore(queue_id, &urgent_sem);
+
+    // Run the events added before the queue was attached
+    schedule_actor(queue_id, actor);
+
+    return 0;
+}
+
+int zz_event_runtime_detach(
+    int32_t queue_id)
+{
+    runtime_actor_t *actor = unlink_actor(queue_id);
+    if (actor == NULL)
+    {
+        fprintf(stderr, "Queue <%d> is not attached to the runtime.\n", queue_id);
+        return 1;
+    }
+
+    // No notification can reach the actor once this returns (the urgent
+    // waker only looks at the attached actors)
+    zz_event_set_queue_ready_callback(queue_id, NULL, NULL);
+    zz_event_set_queue_urgent_semaphore(queue_id, NULL);
+
+    pthread_mutex_lock(&runtime_mtx);
+    actor->detached = true;
+    while (atomic_load(&actor->state) != ACTOR_IDLE)
+    {
+        pthread_cond_wait(&idle_cond, &runtime_mtx);
+    }
+    pthread_mutex_unlock(&runtime_mtx);
+
+    free(actor);
+
+    return 0;
+}
+
+int zz_event_runtime_wait_idle(void)
+{
+    int32_t queue_ids[ZZ_EVENT_EVENT_MAX_EVENT_QUEUE];
+
+    pthread_mutex_lock(&runtime_mtx);
+    if (!running)
+    {
+        pthread_mutex_unlock(&runtime_mtx);
+        return 1;
+    }
+    while (true)
+    {
+        if (run_head || n_busy)
+        {
+            pthread_cond_wait(&idle_cond, &runtime_mtx);
+            continue;
+        }
+
+        // Urgent events not scheduled yet by the urgent waker count as well.
+        // They are counted out of the runtime lock (see urgent_waker_loop)
+        uint64_t generation = idle_generation;
+        uint32_t n_queues = get_attached_queue_ids(queue_ids);
+        pthread_mutex_unlock(&runtime_mtx);
+        uint32_t n_urgent = filter_urgent_queue_ids(queue_ids, n_queues);
+        pthread_mutex_lock(&runtime_mtx);
+        if (n_urgent == 0)
+        {
+            break;
+        }
+        // The workers may have run them already while the lock was released
+        if (generation == idle_generation)
+        {
+            pthread_cond_wait(&idle_cond, &runtime_mtx);
+        }
+    }
+    pthread_mutex_unlock(&runtime_mtx);
+
+    return 0;
+}
+
+int zz_event_runtime_get_processed(
+    uint64_t *n_events)
+{
+    if (n_events == NULL)
+    {
+        return 1;
+    }
+    *n_events = atomic_load(&n_processed);
+
+    return 0;
+}
+
+// Private implementations
+void *worker_loop(void *data)
+{
+    (void)data;
+
+    pthread_mutex_lock(&runtime_mtx);
+    while (true)
+    {
+        while (!stopping && run_head == NULL)
+        {
+            pthread_cond_wait(&work_cond, &runtime_mtx);
+        }
+        if (stopping)
+        {
+            break;
+        }
+
+        runtime_actor_t *actor = pop_actor();
+        n_busy++;
+        bool detached = actor->detached;
+        pthread_mutex_unlock(&runtime_mtx);
+
+        uint32_t n_remaining = 0;
+        if (!detached)
+        {
+            // Events added from now on mark the actor as notified, so it is
+            // scheduled again if this turn misses them
+            atomic_store(&actor->state, ACTOR_RUNNING);
+
+            int32_t n_events = 0;
+            zz_event_process_events_budget(actor->queue_id, events_per_turn, 0, &n_events, &n_remaining);
+            atomic_fetch_add(&n_processed, (uint64_t)n_events);
+        }
+
+        pthread_mutex_lock(&runtime_mtx);
+        finish_turn(actor, n_remaining);
+        n_busy--;
+        if (n_busy == 0 && run_head == NULL)
+        {
+            idle_generation++;
+            pthread_cond_broadcast(&idle_cond);
+        }
+    }
+    pthread_mutex_unlock(&runtime_mtx);
+
+    return NULL;
+}
+
+void *urgent_waker_loop(void *data)
+{
+    (void)data;
+    int32_t queue_ids[ZZ_EVENT_EVENT_MAX_EVENT_QUEUE];
+
+    while (true)
+    {
+        while (sem_wait(&urgent_sem) && errno == EINTR)
+        {
+        }
+
+        pthread_mutex_lock(&runtime_mtx);
+        if (stopping)
+        {
+            pthread_mutex_unlock(&runtime_mtx);
+            break;
+        }
+        // The semaphore does not tell the queue, the attached ones are few
+        uint32_t n_queues = get_attached_queue_ids(queue_ids);
+        pthread_mutex_unlock(&runtime_mtx);
+
+        // Counting the urgent events takes the queue list lock, which must
+        // not be taken under the runtime lock: the producers notify the
+        // runtime while they hold a lock of their queue, taken under the
+        // queue list lock by the event module
+        uint32_t n_urgent = filter_urgent_queue_ids(queue_ids, n_queues);
+        if (n_urgent == 0)
+        {
+            continue;
+        }
+
+        // The actors detached meanwhile are not in the list anymore
+        pthread_mutex_lock(&runtime_mtx);
+        for (runtime_actor_t *actor = actors; actor; actor = actor->next)
+        {
+            for (uint32_t i = 0; i < n_urgent; i++)
+            {
+                if (queue_ids[i] == actor->queue_id && !actor->detached && mark_actor_ready(actor))
+                {
+                    push_actor(actor);
+                    pthread_cond_signal(&work_cond);
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&runtime_mtx);
+    }
+
+    return NULL;
+}
+
+void init_urgent_sem(void)
+{
+    sem_init(&urgent_sem, 0, 0);
+}
+
+uint32_t get_attached_queue_ids(int32_t *queue_ids)
+{
+    // An actor is only attached to an existing queue, so they fit
+    uint32_t n_queues = 0;
+    for (runtime_actor_t *actor = actors; actor && n_queues < ZZ_EVENT_EVENT_MAX_EVENT_QUEUE; actor = actor->next)
+    {
+        queue_ids[n_queues++] = actor->queue_id;
+    }
+
+    return n_queues;
+}
+
+uint32_t filter_urgent_queue_ids(int32_t *queue_ids, uint32_t n_queues)
+{
+    uint32_t n_urgent = 0;
+    for (uint32_t i = 0; i < n_queues; i++)
+    {
+        uint32_t n_events = 0;
+        if (zz_event_get_pending_urgent_events(queue_ids[i], &n_events) == 0 && n_events)
+        {
+            queue_ids[n_urgent++] = queue_ids[i];
+        }
+    }
+
+    return n_urgent;
+}
+
+void schedule_actor(int32_t queue_id, void *ctx)
+{
+    (void)queue_id;
+    runtime_actor_t *actor = ctx;
+
+    // Only the first notification of an idle actor takes the runtime lock,
+    // the queues that are already scheduled or running are left as they are
+    if (mark_actor_ready(actor))
+    {
+        pthread_mutex_lock(&runtime_mtx);
+        push_actor(actor);
+        pthread_cond_signal(&work_cond);
+        pthread_mutex_unlock(&runtime_mtx);
+    }
+}
+
+bool mark_actor_ready(runtime_actor_t *actor)
+{
+    int state = atomic_load(&actor->state);
+    while (true)
+    {
+        if (state == ACTOR_IDLE)
+        {
+            // The caller pushes it to the run queue
+            if (atomic_compare_exchange_weak(&actor->state, &state, ACTOR_SCHEDULED))
+            {
+                return true;
+            }
+        }
+        else if (state == ACTOR_RUNNING)
+        {
+            if (atomic_compare_exchange_weak(&actor->state, &state, ACTOR_RUNNING_NOTIFIED))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+void push_actor(runtime_actor_t *actor)
+{
+    actor->run_next = NULL;
+    if (run_tail)
+    {
+        run_tail->run_next = actor;
+    }
+    else
+    {
+        run_head = actor;
+    }
+    run_tail = actor;
+}
+
+runtime_actor_t *pop_actor(void)
+{
+    runtime_actor_t *actor = run_head;
+    if (actor)
+    {
+        run_head = actor->run_next;
+        if (run_head == NULL)
+        {
+            run_tail = NULL;
+        }
+        actor->run_next = NULL;
+    }
+
+    return actor;
+}
+
+void finish_turn(runtime_actor_t *actor, uint32_t n_remaining)
+{
+    if (actor->detached)
+    {
+        // The detaching thread waits for the idle state to release the actor
+        atomic_store(&actor->state, ACTOR_IDLE);
+        pthread_cond_broadcast(&idle_cond);
+        return;
+    }
+
+    if (n_remaining == 0)
+    {
+        int state = ACTOR_RUNNING;
+        if (atomic_compare_exchange_strong(&actor->state, &state, ACTOR_IDLE))
+        {
+            return;
+        }
+    }
+
+    // Out of budget or notified during the turn: back to the end of the run
+    // queue, behind the other ready queues
+    atomic_store(&actor->state, ACTOR_SCHEDULED);
+    push_actor(actor);
+    pthread_cond_signal(&work_cond);
+}
+
+runtime_actor_t *unlink_actor(int32_t queue_id)
+{
+    pthread_mutex_lock(&runtime_mtx);
+    runtime_actor_t **link = &actors;
+    while (*link && (*link)->queue_id != queue_id)
+    {
+        link = &(*link)->next;
+    }
+    runtime_actor_t *actor = *link;
+    if (actor)
+    {
+        *link = actor->next;
+    }
+    pthread_mutex_unlock(&runtime_mtx);
+
+    return actor;
+}
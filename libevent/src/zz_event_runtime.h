@@ -0,0 +1,110 @@
+#ifndef __ZZ_EVENT_RUNTIME_H__
+#define __ZZ_EVENT_RUNTIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "zz_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Shared runtime that runs the event queues on a fixed pool of worker threads.
+ *
+ * A queue attached to the runtime is scheduled when an event is added to it
+ * and is processed by the first free worker, so the modules do not need their
+ * own thread and polling loop. A queue runs on at most one worker at a time,
+ * so its callbacks never run concurrently with each other (actor model).
+ *
+ * @code
+ * zz_event_runtime_start(4, 64);
+ * zz_event_runtime_attach(MAINAPP_EVENT_QUEUE);
+ * ...
+ * zz_event_runtime_stop();
+ * @endcode
+ */
+
+/// Events processed by a queue in one turn when no limit is given
+#define ZZ_EVENT_RUNTIME_DEFAULT_EVENTS_PER_TURN 64
+
+/**
+ * @brief Starts the worker threads of the runtime
+ *
+ * @param n_workers [in] Number of worker threads, usually the number of cores
+ * @param max_events_per_turn [in] Events of a queue processed before the
+ *                            worker moves to the next ready queue, so a busy
+ *                            queue can not starve the others. 0 uses
+ *                            ZZ_EVENT_RUNTIME_DEFAULT_EVENTS_PER_TURN.
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_start(
+    uint32_t n_workers,
+    uint32_t max_events_per_turn);
+
+/**
+ * @brief Stops the worker threads and detaches all the queues
+ *
+ * The workers finish the turn they are running. The events still pending
+ * are kept in their queues.
+ *
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_stop(void);
+
+/**
+ * @brief Checks if the runtime workers are running
+ *
+ * @return true if the runtime was started and not stopped, false otherwise.
+ */
+bool zz_event_runtime_is_running(void);
+
+/**
+ * @brief Runs a queue in the runtime workers
+ *
+ * The queue is scheduled right away if it already has pending events. Do not
+ * process an attached queue from other threads.
+ *
+ * @param queue_id [in] The queue to run, it must exist
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_attach(
+    int32_t queue_id);
+
+/**
+ * @brief Stops running a queue in the runtime workers
+ *
+ * Waits until no worker is processing the queue. Must not be called from a
+ * callback of the same queue.
+ *
+ * @param queue_id [in] The attached queue
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_detach(
+    int32_t queue_id);
+
+/**
+ * @brief Waits until all the attached queues are empty and no worker is busy
+ *
+ * The urgent events of the attached queues count as well: they are scheduled
+ * by a helper thread of the runtime, woken up by zz_event_post_urgent_event.
+ *
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_wait_idle(void);
+
+/**
+ * @brief Gets the number of events processed by the runtime workers
+ *
+ * @param n_events [out] Events processed since the runtime was started
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_runtime_get_processed(
+    uint64_t *n_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZZ_EVENT_RUNTIME_H__
@@ -0,0 +1,378 @@
+#include "zz_event_trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include <utils.h>
+
+/**
+ * @brief A timestamped point of the life of an event
+ */
+typedef struct trace_record_t
+{
+    /// Nanoseconds of the monotonic clock
+    uint64_t timestamp_ns;
+    int32_t queue_id;
+    uint32_t event_type;
+    /// One of zz_event_trace_point_t
+    uint32_t point;
+    /// Trace id of the event, or number of events of a batch
+    uint64_t id;
+} trace_record_t;
+
+/**
+ * @brief The records of one thread
+ */
+typedef struct trace_buffer_t trace_buffer_t;
+struct trace_buffer_t
+{
+    trace_record_t *records;
+    uint32_t capacity;
+    uint32_t count;
+    /// Records lost because the buffer was full
+    uint64_t dropped;
+    /// Index of the thread in the trace, in order of its first record
+    uint32_t thread_index;
+    /// Set while the owner thread writes a record
+    atomic_bool writing;
+    /// Set when the owner thread exits, the buffer is released on next start
+    atomic_bool exited;
+    trace_buffer_t *next;
+};
+
+/// Protects the buffer list and the trace settings
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_bool trace_active = false;
+
+static uint32_t trace_capacity = ZZ_EVENT_TRACE_DEFAULT_RECORDS;
+
+static uint64_t trace_start_ns = 0;
+
+static uint32_t n_threads = 0;
+
+/// The buffers of all the threads that recorded something
+static trace_buffer_t *buffers = NULL;
+
+/// Buffer of the calling thread
+static _Thread_local trace_buffer_t *thread_buffer = NULL;
+
+/// Marks the buffer of a thread as exited when the thread ends
+static pthread_key_t buffer_key;
+
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+
+// Private prototypes
+void create_buffer_key(void);
+
+void mark_buffer_exited(
+    void *data);
+
+trace_buffer_t *get_thread_buffer(void);
+
+void write_records(
+    FILE *file,
+    const trace_buffer_t *buffer,
+    int pid,
+    bool *first);
+
+void format_flow_id(
+    char *flow_id,
+    size_t size,
+    const trace_record_t *record);
+
+// Public implementation
+int zz_event_trace_start(
+    uint32_t max_records_per_thread)
+{
+    uint32_t capacity = max_records_per_thread ? max_records_per_thread : ZZ_EVENT_TRACE_DEFAULT_RECORDS;
+
+    pthread_mutex_lock(&trace_mtx);
+    if (atomic_load(&trace_active))
+    {
+        pthread_mutex_unlock(&trace_mtx);
+        fprintf(stderr, "There is already a trace running.\n");
+        return 1;
+    }
+
+    // No thread writes while the trace is stopped, so the buffers can be
+    // emptied or released here
+    trace_buffer_t **link = &buffers;
+    while (*link)
+    {
+        trace_buffer_t *buffer = *link;
+        if (atomic_load(&buffer->exited))
+        {
+            *link = buffer->next;
+            free(buffer->records);
+            free(buffer);
+            continue;
+        }
+
+        if (buffer->capacity != capacity)
+        {
+            trace_record_t *records = realloc(buffer->records, capacity * sizeof(trace_record_t));
+            if (records == NULL)
+            {
+                pthread_mutex_unlock(&trace_mtx);
+                fprintf(stderr, "Unable to allocate %u trace records.\n", capacity);
+                return 1;
+            }
+            buffer->records = records;
+            buffer->capacity = capacity;
+        }
+        buffer->count = 0;
+        buffer->dropped = 0;
+        link = &buffer->next;
+    }
+
+    trace_capacity = capacity;
+    trace_start_ns = getMonotonicNs();
+    atomic_store(&trace_active, true);
+    pthread_mutex_unlock(&trace_mtx);
+
+    return 0;
+}
+
+int zz_event_trace_stop(void)
+{
+    pthread_mutex_lock(&trace_mtx);
+    if (!atomic_exchange(&trace_active, false))
+    {
+        pthread_mutex_unlock(&trace_mtx);
+        fprintf(stderr, "There is no trace running.\n");
+        return 1;
+    }
+
+    // Wait for the records being written, the next ones see the trace stopped
+    for (trace_buffer_t *buffer = buffers; buffer; buffer = buffer->next)
+    {
+        while (atomic_load(&buffer->writing))
+        {
+            sched_yield();
+        }
+    }
+    pthread_mutex_unlock(&trace_mtx);
+
+    return 0;
+}
+
+bool zz_event_trace_is_active(void)
+{
+    return atomic_load_explicit(&trace_active, memory_order_relaxed);
+}
+
+void zz_event_trace_record(
+    zz_event_trace_point_t point,
+    int32_t queue_id,
+    uint32_t event_type,
+    uint64_t id)
+{
+    zz_event_trace_record_at(point, queue_id, event_type, id, 0);
+}
+
+void zz_event_trace_record_at(
+    zz_event_trace_point_t point,
+    int32_t queue_id,
+    uint32_t event_type,
+    uint64_t id,
+    uint64_t timestamp_ns)
+{
+    trace_buffer_t *buffer = thread_buffer ? thread_buffer : get_thread_buffer();
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    // Sequentially consistent, ordered with trace_active cleared by
+    // zz_event_trace_stop before it waits for the writers
+    atomic_store(&buffer->writing, true);
+    // A point reached before the trace started (e.g. the post of an urgent
+    // event dispatched after it) is dropped, like the other ones of that time
+    if (atomic_load(&trace_active) && (timestamp_ns == 0 || timestamp_ns >= trace_start_ns))
+    {
+        if (buffer->count < buffer->capacity)
+        {
+            trace_record_t *record = &buffer->records[buffer->count++];
+            record->timestamp_ns = timestamp_ns ? timestamp_ns : getMonotonicNs();
+            record->queue_id = queue_id;
+            record->event_type = event_type;
+            record->point = (uint32_t)point;
+            record->id = id;
+        }
+        else
+        {
+            buffer->dropped++;
+        }
+    }
+    atomic_store_explicit(&buffer->writing, false, memory_order_release);
+}
+
+int zz_event_trace_dump(
+    const char *path)
+{
+    pthread_mutex_lock(&trace_mtx);
+    if (atomic_load(&trace_active))
+    {
+        pthread_mutex_unlock(&trace_mtx);
+        fprintf(stderr, "Stop the trace before dumping it.\n");
+        return 1;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        pthread_mutex_unlock(&trace_mtx);
+        fprintf(stderr, "Unable to create trace file <%s>. Err: %d\n", path, errno);
+        return 1;
+    }
+
+    uint64_t dropped = 0;
+    for (trace_buffer_t *buffer = buffers; buffer; buffer = buffer->next)
+    {
+        dropped += buffer->dropped;
+    }
+
+    int pid = (int)getpid();
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_records\":%" PRIu64 "},\"traceEvents\":[\n", dropped);
+    for (trace_buffer_t *buffer = buffers; buffer; buffer = buffer->next)
+    {
+        write_records(file, buffer, pid, &first);
+    }
+    fprintf(file, "\n]}\n");
+    pthread_mutex_unlock(&trace_mtx);
+
+    if (dropped)
+    {
+        fprintf(stderr, "%" PRIu64 " trace records dropped, the thread buffers were full.\n", dropped);
+    }
+
+    return fclose(file) ? 1 : 0;
+}
+
+// Private implementations
+void create_buffer_key(void)
+{
+    pthread_key_create(&buffer_key, &mark_buffer_exited);
+}
+
+void mark_buffer_exited(void *data)
+{
+    trace_buffer_t *buffer = data;
+    atomic_store(&buffer->exited, true);
+}
+
+trace_buffer_t *get_thread_buffer(void)
+{
+    pthread_once(&buffer_key_once, &create_buffer_key);
+
+    trace_buffer_t *buffer = calloc(1, sizeof(trace_buffer_t));
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&trace_mtx);
+    buffer->capacity = trace_capacity;
+    buffer->records = malloc(buffer->capacity * sizeof(trace_record_t));
+    if (buffer->records == NULL)
+    {
+        pthread_mutex_unlock(&trace_mtx);
+        free(buffer);
+        return NULL;
+    }
+    buffer->thread_index = n_threads++;
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&trace_mtx);
+
+    pthread_setspecific(buffer_key, buffer);
+    thread_buffer = buffer;
+
+    return buffer;
+}
+
+void write_records(FILE *file, const trace_buffer_t *buffer, int pid, bool *first)
+{
+    if (buffer->count == 0)
+    {
+        return;
+    }
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+            *first ? "" : ",\n", pid, buffer->thread_index, buffer->thread_index);
+    *first = false;
+
+    for (uint32_t i = 0; i < buffer->count; i++)
+    {
+        const trace_record_t *record = &buffer->records[i];
+        double ts_us = (double)(record->timestamp_ns - trace_start_ns) / 1000.0;
+        char flow_id[32];
+        format_flow_id(flow_id, sizeof(flow_id), record);
+
+        // The post and the dispatch of an event are linked by a flow arrow,
+        // the time between them is the time it waited in the queue
+        switch (record->point)
+        {
+        case ZZ_EVENT_TRACE_ENQUEUE:
+            fprintf(file,
+                    ",\n{\"name\":\"post %u\",\"cat\":\"queue %d\",\"ph\":\"X\",\"dur\":0,\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"queue\":%d,\"type\":%u,\"id\":\"%s\"}}",
+                    record->event_type, record->queue_id, ts_us, pid, buffer->thread_index,
+                    record->queue_id, record->event_type, flow_id);
+            fprintf(file,
+                    ",\n{\"name\":\"event\",\"cat\":\"queue %d\",\"ph\":\"s\",\"id\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    record->queue_id, flow_id, ts_us, pid, buffer->thread_index);
+            break;
+        case ZZ_EVENT_TRACE_DEQUEUE:
+            fprintf(file,
+                    ",\n{\"name\":\"event %u\",\"cat\":\"queue %d\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"queue\":%d,\"type\":%u,\"id\":\"%s\"}}",
+                    record->event_type, record->queue_id, ts_us, pid, buffer->thread_index,
+                    record->queue_id, record->event_type, flow_id);
+            fprintf(file,
+                    ",\n{\"name\":\"event\",\"cat\":\"queue %d\",\"ph\":\"f\",\"bp\":\"e\",\"id\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    record->queue_id, flow_id, ts_us, pid, buffer->thread_index);
+            break;
+        case ZZ_EVENT_TRACE_BATCH:
+            fprintf(file,
+                    ",\n{\"name\":\"batch %u\",\"cat\":\"queue %d\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"queue\":%d,\"type\":%u,\"events\":%" PRIu64 "}}",
+                    record->event_type, record->queue_id, ts_us, pid, buffer->thread_index,
+                    record->queue_id, record->event_type, record->id);
+            break;
+        case ZZ_EVENT_TRACE_BATCH_EVENT:
+            // Only the arrow, the events of the batch share its slice
+            fprintf(file,
+                    ",\n{\"name\":\"event\",\"cat\":\"queue %d\",\"ph\":\"f\",\"bp\":\"e\",\"id\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    record->queue_id, flow_id, ts_us, pid, buffer->thread_index);
+            break;
+        case ZZ_EVENT_TRACE_DONE:
+            fprintf(file, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}", ts_us, pid, buffer->thread_index);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void format_flow_id(char *flow_id, size_t size, const trace_record_t *record)
+{
+    // Unique per queue: the uuid, or the lane position of an urgent event
+    if (record->id & ZZ_EVENT_TRACE_URGENT_ID)
+    {
+        snprintf(flow_id, size, "%d:u%" PRIu64, record->queue_id, record->id & ~ZZ_EVENT_TRACE_URGENT_ID);
+    }
+    else
+    {
+        snprintf(flow_id, size, "%d:%" PRIu64, record->queue_id, record->id);
+    }
+}
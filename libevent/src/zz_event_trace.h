@@ -0,0 +1,137 @@
+#ifndef __ZZ_EVENT_TRACE_H__
+#define __ZZ_EVENT_TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timing of every event from the post to the end of its callbacks.
+ *
+ * While the trace is running the event module timestamps every event when it
+ * is added to a queue, when the consumer takes it and when its callbacks
+ * return. Each thread writes its timestamps into its own preallocated buffer
+ * without locking. The trace is saved as Chrome trace JSON, to be opened with
+ * chrome://tracing or https://ui.perfetto.dev, where the handlers show up as
+ * slices on the consumer threads and an arrow links each one to its post.
+ * The events dispatched together to a batch callback share one slice. The
+ * post of an urgent event (maybe from a signal handler) is timestamped there
+ * and recorded by the consumer when it takes the event.
+ *
+ * @code
+ * zz_event_trace_start(0);
+ * ...
+ * zz_event_trace_stop();
+ * zz_event_trace_dump("events.json");
+ * @endcode
+ */
+
+/// Records kept per thread if zz_event_trace_start is given 0
+#define ZZ_EVENT_TRACE_DEFAULT_RECORDS (64 * 1024)
+
+/// The urgent events have no uuid, their trace id is their position in the
+/// urgent lane of the queue tagged with this bit
+#define ZZ_EVENT_TRACE_URGENT_ID ((uint64_t)1 << 32)
+
+/**
+ * @brief Point of the event life recorded
+ */
+typedef enum zz_event_trace_point_t
+{
+    /// The event was added to the queue
+    ZZ_EVENT_TRACE_ENQUEUE = 0,
+    /// The consumer took the event from the queue
+    ZZ_EVENT_TRACE_DEQUEUE = 1,
+    /// The callbacks of the event (or batch) returned
+    ZZ_EVENT_TRACE_DONE = 2,
+    /// The consumer dispatches a batch of events, recorded with the number of
+    /// events as id and closed by a single ZZ_EVENT_TRACE_DONE
+    ZZ_EVENT_TRACE_BATCH = 3,
+    /// An event of the batch recorded just before
+    ZZ_EVENT_TRACE_BATCH_EVENT = 4,
+} zz_event_trace_point_t;
+
+/**
+ * @brief Starts timestamping the events, discarding the previous trace
+ *
+ * The threads allocate their buffer on their first record. Once a buffer is
+ * full the thread drops its records until the next start.
+ *
+ * @param max_records_per_thread [in] Capacity of each thread buffer, or 0 for
+ *                               ZZ_EVENT_TRACE_DEFAULT_RECORDS
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_trace_start(
+    uint32_t max_records_per_thread);
+
+/**
+ * @brief Stops timestamping the events, the trace is kept until dumped
+ *
+ * @return int 0 if success, error code otherwise.
+ */
+int zz_event_trace_stop(void);
+
+/**
+ * @brief Checks if the trace is running
+ *
+ * @return true if the events are being timestamped, false otherwise.
+ */
+bool zz_event_trace_is_active(void);
+
+/**
+ * @brief Timestamps a point of the life of an event
+ *
+ * Called by the event module. Lock free, it only writes in the buffer of the
+ * calling thread.
+ *
+ * @param point [in] The point reached by the event
+ * @param queue_id [in] Queue of the event
+ * @param event_type [in] The event type id
+ * @param id [in] The uuid of the event in its queue, see also
+ *           ZZ_EVENT_TRACE_URGENT_ID and ZZ_EVENT_TRACE_BATCH
+ */
+void zz_event_trace_record(
+    zz_event_trace_point_t point,
+    int32_t queue_id,
+    uint32_t event_type,
+    uint64_t id);
+
+/**
+ * @brief Records a point of the life of an event reached earlier
+ *
+ * Like zz_event_trace_record, for the points timestamped where the trace can
+ * not be written (e.g. in a signal handler).
+ *
+ * @param point [in] The point reached by the event
+ * @param queue_id [in] Queue of the event
+ * @param event_type [in] The event type id
+ * @param id [in] The trace id of the event
+ * @param timestamp_ns [in] When the point was reached, in nanoseconds of the
+ *                     monotonic clock. Points reached before the trace was
+ *                     started are not recorded.
+ */
+void zz_event_trace_record_at(
+    zz_event_trace_point_t point,
+    int32_t queue_id,
+    uint32_t event_type,
+    uint64_t id,
+    uint64_t timestamp_ns);
+
+/**
+ * @brief Writes the last trace as Chrome trace JSON
+ *
+ * @param path [in] The JSON file to be created. It is truncated if it exists.
+ * @return int 0 if success, error code otherwise (also if the trace is still
+ *         running).
+ */
+int zz_event_trace_dump(
+    const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZZ_EVENT_TRACE_H__
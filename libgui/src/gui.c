@@ -9,15 +9,18 @@
 #include <definitions.h>
 #include <zz_event.h>
 
+/// Maximum time the loop waits for events before running the periodic tasks
+#define GUI_LOOP_PERIOD_US 100000
+
 static bool exit = false;
 
-static int some_number = 0;
+static int32_t some_number = 0;
 
-pthread_mutex_t exitLock;
+static pthread_mutex_t exitLock;
 
 // Private prototypes
 void print_text(zz_event_list_t *event);
-void get_square_ready(zz_event_list_t *event);
+void get_square_ready(int32_t *square);
 
 // Public implementation
 void gui_init(void)
@@ -33,8 +36,7 @@ void gui_init(void)
     zz_event_register_event_type_callback(
         GUI_EVENT_QUEUE, EVENT_GUI_PRINT_TEXT, &print_text);
 
-    zz_event_register_event_type_callback(
-        GUI_EVENT_QUEUE, EVENT_GUI_GET_SQUARE_READY, &get_square_ready);
+    gui_get_square_ready_register(&get_square_ready);
 }
 
 void gui_deinit(void)
@@ -60,10 +62,7 @@ void *gui_main_loop(void *data)
         {
             for (int i = 0; i < 5; i++)
             {
-                int err = zz_event_create_event_in_queue(
-                    MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_GET_SQUARE,
-                    ZZ_EVENT_DATA_TYPE_SIGNED_INT, &some_number, sizeof(int), NULL);
-                if (err)
+                if (mainapp_get_square_post(&some_number))
                 {
                     fprintf(stderr, "Unable to create get square event.");
                 }
@@ -72,7 +71,8 @@ void *gui_main_loop(void *data)
             start_time = getTicksMs();
         }
 
-        msleep(100);
+        // Sleeps until the next event or the next periodic task
+        zz_event_wait_events(GUI_EVENT_QUEUE, GUI_LOOP_PERIOD_US, NULL);
     }
 
     return NULL;
@@ -90,7 +90,7 @@ void print_text(zz_event_list_t *event)
 {
     if (event->data_type == ZZ_EVENT_DATA_TYPE_STRING)
     {
-        printf("Text received: [%s]\n", (char *)(event->data));
+        printf("Text received: [%s]\n", (char *)zz_event_data(event));
     }
     else
     {
@@ -99,11 +99,7 @@ void print_text(zz_event_list_t *event)
     fflush(stdout);
 }
 
-void get_square_ready(zz_event_list_t *event)
+void get_square_ready(int32_t *square)
 {
-    if (event->event_type == EVENT_GUI_GET_SQUARE_READY &&
-        event->data_type == ZZ_EVENT_DATA_TYPE_SIGNED_INT)
-    {
-        printf("Square: %d\n", *(int *)(event->data));
-    }
+    printf("Square: %d\n", *square);
 }
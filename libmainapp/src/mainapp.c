@@ -10,13 +10,19 @@
 #include <definitions.h>
 #include <zz_event.h>
 
+/// Maximum time spent processing events in each loop iteration
+#define MAINAPP_EVENTS_BUDGET_US 50000
+
+/// Maximum time the loop waits for events before running the periodic tasks
+#define MAINAPP_LOOP_PERIOD_US 100000
+
 static bool exit = false;
 
-pthread_mutex_t exitLock;
+static pthread_mutex_t exitLock;
 
 // Private prototypes
 void quit_mainapp(zz_event_list_t *event);
-void get_square(zz_event_list_t *event);
+void get_squares(const int32_t *numbers, uint32_t n_numbers);
 
 // Public implementation
 void mainapp_init(void)
@@ -31,8 +37,7 @@ void mainapp_init(void)
     zz_event_register_event_type_callback(
         MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_QUIT_APP, &quit_mainapp);
 
-    zz_event_register_event_type_callback(
-        MAINAPP_EVENT_QUEUE, EVENT_MAINAPP_GET_SQUARE, &get_square);
+    mainapp_get_square_register_batch(&get_squares);
 }
 
 void mainapp_deinit(void)
@@ -52,7 +57,8 @@ void* mainapp_main_loop(void* data)
 
     while (!exit)
     {
-        zz_event_process_events(MAINAPP_EVENT_QUEUE, NULL);
+        zz_event_process_events_budget(
+            MAINAPP_EVENT_QUEUE, 0, MAINAPP_EVENTS_BUDGET_US, NULL, NULL);
         uint64_t elapsed_time = getTicksMs() - start_time;
         if (elapsed_time > 1500)
         {
@@ -69,7 +75,8 @@ void* mainapp_main_loop(void* data)
             }
             start_time = getTicksMs();
         }
-        msleep(100);
+        // Sleeps until the next event or the next periodic task
+        zz_event_wait_events(MAINAPP_EVENT_QUEUE, MAINAPP_LOOP_PERIOD_US, NULL);
     }
 
     return NULL;
@@ -91,22 +98,18 @@ void quit_mainapp(zz_event_list_t *event)
     }
 }
 
-void get_square(zz_event_list_t *event)
+void get_squares(const int32_t *numbers, uint32_t n_numbers)
 {
-    if (event->event_type == EVENT_MAINAPP_GET_SQUARE && 
-        event->data_type == ZZ_EVENT_DATA_TYPE_SIGNED_INT) 
+    // The requests pending in the queue arrive together: square them in a
+    // single loop the compiler can vectorize and reply with a single post
+    int32_t squares[ZZ_EVENT_BATCH_MAX_EVENTS];
+    for (uint32_t i = 0; i < n_numbers; i++)
     {
-        // Ideally the precision of the int should be handled by the data_size
-        // and then create a int8_t, int16_t, int32_t, ... , accordingly.
-        int ret = *(int*)(event->data);
-        ret *= ret;
-        int err = zz_event_create_event_in_queue(
-            GUI_EVENT_QUEUE, EVENT_GUI_GET_SQUARE_READY,
-            ZZ_EVENT_DATA_TYPE_SIGNED_INT, (void *)&ret, sizeof(int), NULL);
-
-        if (err)
-        {
-            fprintf(stderr, "Unable to create get square ready event.\n");
-        }
+        squares[i] = numbers[i] * numbers[i];
+    }
+
+    if (gui_get_square_ready_post_batch(squares, n_numbers))
+    {
+        fprintf(stderr, "Unable to create get square ready events.\n");
     }
 }
@@ -27,7 +27,14 @@ int msleep(int msec)
 
 uint64_t getTicksMs(void)
 {
-    clock_t now = clock();
-    uint64_t ret = (now * 1000000) / CLOCKS_PER_SEC;
-    return ret;
+    // clock() counts the CPU time of the process, which stops while the
+    // threads sleep waiting for events, use the monotonic clock instead
+    return getMonotonicNs() / 1000000;
+}
+
+uint64_t getMonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
@@ -12,12 +12,19 @@
 int msleep(int msec);
 
 /**
- * @brief Get the milliseconds elapsed since the app started
+ * @brief Get the milliseconds elapsed from an arbitrary fixed point
  * 
- * @return uint64_t The milliseconds elapsed since the app started
- * 
- * @remark This is not a very precise way to count time, but it is enough
+ * @return uint64_t The current value of the monotonic clock in milliseconds
  */
 uint64_t getTicksMs(void);
 
+/**
+ * @brief Get the nanoseconds elapsed from an arbitrary fixed point
+ * 
+ * @return uint64_t The current value of the monotonic clock in nanoseconds
+ * 
+ * @remark Use it to measure intervals, it is not related to the wall clock
+ */
+uint64_t getMonotonicNs(void);
+
 #endif // __UTILS_H__
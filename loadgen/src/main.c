@@ -0,0 +1,830 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include <pthread.h>
+
+#include <zz_event.h>
+#include <zz_event_runtime.h>
+#include <utils.h>
+
+/// Every payload starts with the post timestamp, so it is never smaller
+#define MIN_PAYLOAD_SIZE sizeof(uint64_t)
+
+/// Longest sleep of a consumer before it checks if the run is over
+#define CONSUMER_WAIT_US 1000
+
+/// Events of a queue processed before a consumer of several queues moves on
+#define CONSUMER_EVENTS_PER_TURN 64
+
+/// Longest time given to the consumers to drain the queues after the run
+#define DRAIN_TIMEOUT_MS 10000
+
+/// Sub buckets per power of two of the latency histogram (3% precision)
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @brief How the payload sizes are drawn
+ */
+typedef enum size_distribution_t
+{
+    /// Always size_a bytes
+    SIZE_FIXED = 0,
+    /// Uniform between size_a and size_b bytes
+    SIZE_UNIFORM = 1,
+    /// Exponential with a mean of size_a bytes, capped at size_b
+    SIZE_EXP = 2,
+} size_distribution_t;
+
+/**
+ * @brief How the queues are consumed
+ */
+typedef struct consumer_mode_t
+{
+    const char *name;
+    /// Wait strategy of the dedicated consumers
+    zz_event_wait_mode_t wait_mode;
+    /// The queues are run by the runtime workers instead
+    bool runtime;
+} consumer_mode_t;
+
+static const consumer_mode_t consumer_modes[] = {
+    {"park", ZZ_EVENT_WAIT_PARK, false},
+    {"spin", ZZ_EVENT_WAIT_SPIN, false},
+    {"yield", ZZ_EVENT_WAIT_YIELD, false},
+    {"runtime", ZZ_EVENT_WAIT_PARK, true},
+};
+
+/**
+ * @brief The load to generate
+ */
+typedef struct loadgen_config_t
+{
+    uint32_t n_producers;
+    uint32_t n_consumers;
+    uint32_t n_queues;
+    uint32_t n_event_types;
+    size_distribution_t size_distribution;
+    uint32_t size_a;
+    uint32_t size_b;
+    /// Events per second of each producer, 0 posts as fast as possible
+    double rate;
+    double duration_s;
+    const consumer_mode_t *mode;
+    /// Events posted at once, more than 1 also dispatches them in batches
+    uint32_t batch;
+    /// Pending events of a queue above which the producers drop their
+    /// events, 0 for no limit
+    uint32_t max_pending;
+} loadgen_config_t;
+
+/**
+ * @brief Counters of a queue, written by its producers and consumers
+ */
+typedef struct queue_counters_t
+{
+    _Alignas(64) atomic_uint_fast64_t posted;
+    _Alignas(64) atomic_uint_fast64_t processed;
+} queue_counters_t;
+
+typedef struct producer_t
+{
+    pthread_t thread;
+    uint32_t index;
+    uint64_t posted;
+    /// Events not posted because the queue was above max_pending
+    uint64_t dropped;
+    /// Events the event module refused
+    uint64_t failed;
+} producer_t;
+
+typedef struct consumer_t
+{
+    pthread_t thread;
+    int32_t *queue_ids;
+    uint32_t n_queues;
+} consumer_t;
+
+/**
+ * @brief Latencies seen by one consumer thread
+ */
+typedef struct latency_stats_t latency_stats_t;
+struct latency_stats_t
+{
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t max_ns;
+    latency_stats_t *next;
+};
+
+static loadgen_config_t config = {
+    .n_producers = 2,
+    .n_consumers = 1,
+    .n_queues = 1,
+    .n_event_types = 4,
+    .size_distribution = SIZE_FIXED,
+    .size_a = 16,
+    .size_b = 16,
+    .rate = 0,
+    .duration_s = 5,
+    .mode = &consumer_modes[0],
+    .batch = 1,
+    .max_pending = 0,
+};
+
+static queue_counters_t *queue_counters = NULL;
+
+static atomic_bool stop_producers = false;
+
+static atomic_bool stop_consumers = false;
+
+/// Latencies of every consumer thread, merged at the end of the run
+static latency_stats_t *all_stats = NULL;
+
+static pthread_mutex_t stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/// Latencies of the calling consumer thread, allocated on its first event
+static _Thread_local latency_stats_t *thread_stats = NULL;
+
+// Private prototypes
+void print_usage(
+    const char *name);
+
+int parse_options(
+    int argc,
+    char **argv);
+
+int parse_size_distribution(
+    const char *text);
+
+int setup_queues(void);
+
+void *run_producer(
+    void *arg);
+
+void *run_consumer(
+    void *arg);
+
+uint32_t draw_payload_size(
+    uint64_t *rng);
+
+uint64_t next_random(
+    uint64_t *state);
+
+void pace_until_ns(
+    uint64_t deadline_ns);
+
+void handle_event(
+    zz_event_list_t *event,
+    void *ctx);
+
+void handle_batch(
+    const zz_event_batch_t *batch,
+    void *ctx);
+
+void record_latency(
+    uint64_t latency_ns);
+
+uint32_t histogram_bucket(
+    uint64_t value);
+
+uint64_t histogram_bucket_max(
+    uint32_t bucket);
+
+uint64_t get_posted(void);
+
+uint64_t get_processed(void);
+
+void print_latencies(void);
+
+int main(int argc, char **argv)
+{
+    if (parse_options(argc, argv))
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    zz_event_init();
+    zz_event_set_verbose(false);
+
+    queue_counters = aligned_alloc(_Alignof(queue_counters_t), config.n_queues * sizeof(queue_counters_t));
+    producer_t *producers = calloc(config.n_producers, sizeof(producer_t));
+    consumer_t *consumers = calloc(config.n_consumers, sizeof(consumer_t));
+    int32_t *consumer_queue_ids = calloc(config.n_queues, sizeof(int32_t));
+    if (queue_counters == NULL || producers == NULL || consumers == NULL || consumer_queue_ids == NULL ||
+        setup_queues())
+    {
+        fprintf(stderr, "Unable to set up the queues.\n");
+        zz_event_deinit();
+        return EXIT_FAILURE;
+    }
+
+    printf("Load: %u producers, %u consumers (%s), %u queues, %u event types, batches of %u\n",
+           config.n_producers, config.n_consumers, config.mode->name, config.n_queues,
+           config.n_event_types, config.batch);
+    if (config.rate > 0)
+    {
+        printf("      %.0f events/s per producer for %.1f s", config.rate, config.duration_s);
+    }
+    else
+    {
+        printf("      unlimited rate for %.1f s", config.duration_s);
+    }
+    printf(", payload %s %u..%u bytes, max pending %u per queue\n",
+           config.size_distribution == SIZE_FIXED ? "fixed" : config.size_distribution == SIZE_UNIFORM ? "uniform" : "exp",
+           config.size_a, config.size_b, config.max_pending);
+
+    int err = 0;
+    if (config.mode->runtime)
+    {
+        err = zz_event_runtime_start(config.n_consumers, 0);
+        for (uint32_t i = 0; i < config.n_queues && !err; i++)
+        {
+            err = zz_event_runtime_attach((int32_t)i + 1);
+        }
+    }
+    else
+    {
+        // Each queue has a single consumer, the only thread that may wait
+        // for it
+        uint32_t n_assigned = 0;
+        for (uint32_t i = 0; i < config.n_consumers; i++)
+        {
+            consumers[i].queue_ids = &consumer_queue_ids[n_assigned];
+            for (uint32_t j = i; j < config.n_queues; j += config.n_consumers)
+            {
+                consumer_queue_ids[n_assigned++] = (int32_t)j + 1;
+                consumers[i].n_queues++;
+            }
+            err = err ? err : pthread_create(&consumers[i].thread, NULL, &run_consumer, &consumers[i]);
+        }
+    }
+
+    uint64_t start_ns = getMonotonicNs();
+    for (uint32_t i = 0; i < config.n_producers && !err; i++)
+    {
+        producers[i].index = i;
+        err = pthread_create(&producers[i].thread, NULL, &run_producer, &producers[i]);
+    }
+    if (err)
+    {
+        fprintf(stderr, "Unable to start the threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Throughput of every second of the run
+    uint64_t duration_ns = (uint64_t)(config.duration_s * 1e9);
+    uint64_t last_ns = start_ns;
+    uint64_t last_posted = 0;
+    uint64_t last_processed = 0;
+    while (last_ns - start_ns < duration_ns)
+    {
+        // A last sleep of 0 ms would report the same instant again
+        uint64_t left_ns = duration_ns - (last_ns - start_ns);
+        if (left_ns < 1000000ULL)
+        {
+            break;
+        }
+        msleep((int)((left_ns < 1000000000ULL ? left_ns : 1000000000ULL) / 1000000));
+
+        uint64_t now_ns = getMonotonicNs();
+        uint64_t posted = get_posted();
+        uint64_t processed = get_processed();
+        double elapsed_s = (double)(now_ns - last_ns) / 1e9;
+        printf("%6.1f s: posted %10.0f events/s, processed %10.0f events/s, pending %" PRIu64 "\n",
+               (double)(now_ns - start_ns) / 1e9,
+               (double)(posted - last_posted) / elapsed_s,
+               (double)(processed - last_processed) / elapsed_s,
+               posted > processed ? posted - processed : 0);
+        last_ns = now_ns;
+        last_posted = posted;
+        last_processed = processed;
+    }
+
+    atomic_store(&stop_producers, true);
+    for (uint32_t i = 0; i < config.n_producers; i++)
+    {
+        pthread_join(producers[i].thread, NULL);
+    }
+    uint64_t run_ns = getMonotonicNs() - start_ns;
+    uint64_t processed_in_run = get_processed();
+
+    // Let the consumers finish the pending events, their latency counts too
+    uint64_t drain_start_ms = getTicksMs();
+    while (get_processed() < get_posted() && getTicksMs() - drain_start_ms < DRAIN_TIMEOUT_MS)
+    {
+        msleep(1);
+    }
+    uint64_t drain_ms = getTicksMs() - drain_start_ms;
+
+    atomic_store(&stop_consumers, true);
+    if (config.mode->runtime)
+    {
+        zz_event_runtime_stop();
+    }
+    else
+    {
+        for (uint32_t i = 0; i < config.n_consumers; i++)
+        {
+            pthread_join(consumers[i].thread, NULL);
+        }
+    }
+
+    uint64_t posted = 0;
+    uint64_t dropped = 0;
+    uint64_t failed = 0;
+    for (uint32_t i = 0; i < config.n_producers; i++)
+    {
+        posted += producers[i].posted;
+        dropped += producers[i].dropped;
+        failed += producers[i].failed;
+    }
+    uint64_t processed = get_processed();
+    double run_s = (double)run_ns / 1e9;
+
+    printf("Posted:    %" PRIu64 " events in %.3f s (%.0f events/s)\n", posted, run_s, (double)posted / run_s);
+    printf("Processed: %" PRIu64 " events in %.3f s (%.0f events/s), %" PRIu64 " more in %" PRIu64 " ms of drain\n",
+           processed_in_run, run_s, (double)processed_in_run / run_s, processed - processed_in_run, drain_ms);
+    printf("Dropped:   %" PRIu64 " events over the pending limit, %" PRIu64 " refused by the queues\n", dropped, failed);
+    if (processed < posted)
+    {
+        printf("Lost:      %" PRIu64 " events still pending after the drain\n", posted - processed);
+    }
+    print_latencies();
+
+    for (uint32_t i = 0; i < config.n_queues; i++)
+    {
+        zz_event_delete_queue((int32_t)i + 1);
+    }
+    zz_event_deinit();
+
+    while (all_stats)
+    {
+        latency_stats_t *next = all_stats->next;
+        free(all_stats);
+        all_stats = next;
+    }
+    free(consumer_queue_ids);
+    free(consumers);
+    free(producers);
+    free(queue_counters);
+
+    return processed == posted && failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Private implementations
+void print_usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -p N      producer threads (default 2).\n");
+    fprintf(stderr, "  -c N      consumer threads (default 1).\n");
+    fprintf(stderr, "  -q N      queues, the producers post to all of them in turn (default 1).\n");
+    fprintf(stderr, "  -t N      event types, posted in turn (default 4).\n");
+    fprintf(stderr, "  -s SIZE   payload size in bytes (default 16), one of:\n");
+    fprintf(stderr, "              N, uniform:MIN:MAX, exp:MEAN:MAX. At least %zu bytes.\n", MIN_PAYLOAD_SIZE);
+    fprintf(stderr, "  -r RATE   events per second of each producer, 0 for no limit (default 0).\n");
+    fprintf(stderr, "  -d SEC    duration of the run in seconds (default 5).\n");
+    fprintf(stderr, "  -m MODE   how the queues are consumed (default park):\n");
+    fprintf(stderr, "              park, spin, yield: dedicated consumers with that wait strategy,\n");
+    fprintf(stderr, "              each queue has one consumer, a consumer can have several queues.\n");
+    fprintf(stderr, "              runtime: the consumers are runtime workers shared by all queues.\n");
+    fprintf(stderr, "  -b N      events posted at once and dispatched as a batch (default 1).\n");
+    fprintf(stderr, "  -l N      pending events of a queue above which the events are dropped,\n");
+    fprintf(stderr, "            0 for no limit (default 0). Without -r the producers wait\n");
+    fprintf(stderr, "            for the queue to go below the limit instead.\n");
+}
+
+int parse_options(int argc, char **argv)
+{
+    int option = 0;
+    while ((option = getopt(argc, argv, "p:c:q:t:s:r:d:m:b:l:")) != -1)
+    {
+        switch (option)
+        {
+        case 'p':
+            config.n_producers = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            config.n_consumers = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            config.n_queues = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            config.n_event_types = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            if (parse_size_distribution(optarg))
+            {
+                return 1;
+            }
+            break;
+        case 'r':
+            config.rate = atof(optarg);
+            break;
+        case 'd':
+            config.duration_s = atof(optarg);
+            break;
+        case 'm':
+            config.mode = NULL;
+            for (size_t i = 0; i < sizeof(consumer_modes) / sizeof(consumer_modes[0]); i++)
+            {
+                if (strcmp(optarg, consumer_modes[i].name) == 0)
+                {
+                    config.mode = &consumer_modes[i];
+                }
+            }
+            if (config.mode == NULL)
+            {
+                fprintf(stderr, "Unknown mode <%s>.\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            config.batch = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            config.max_pending = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    if (optind < argc || config.n_producers < 1 || config.n_consumers < 1 || config.n_queues < 1 ||
+        config.n_event_types < 1 || config.batch < 1 || config.rate < 0 || config.duration_s <= 0)
+    {
+        fprintf(stderr, "Wrong options.\n");
+        return 1;
+    }
+    if (config.n_queues > ZZ_EVENT_EVENT_MAX_EVENT_QUEUE)
+    {
+        fprintf(stderr, "Only %d queues are supported.\n", ZZ_EVENT_EVENT_MAX_EVENT_QUEUE);
+        return 1;
+    }
+    if (!config.mode->runtime && config.n_consumers > config.n_queues)
+    {
+        fprintf(stderr, "Mode %s needs a queue per consumer, use more queues or the runtime mode.\n", config.mode->name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int parse_size_distribution(const char *text)
+{
+    unsigned a = 0;
+    unsigned b = 0;
+    if (sscanf(text, "uniform:%u:%u", &a, &b) == 2 && a <= b)
+    {
+        config.size_distribution = SIZE_UNIFORM;
+    }
+    else if (sscanf(text, "exp:%u:%u", &a, &b) == 2 && a <= b)
+    {
+        config.size_distribution = SIZE_EXP;
+    }
+    else if (sscanf(text, "%u", &a) == 1)
+    {
+        config.size_distribution = SIZE_FIXED;
+        b = a;
+    }
+    else
+    {
+        fprintf(stderr, "Wrong payload size <%s>.\n", text);
+        return 1;
+    }
+
+    if (a < MIN_PAYLOAD_SIZE)
+    {
+        fprintf(stderr, "The payloads are at least %zu bytes.\n", MIN_PAYLOAD_SIZE);
+        return 1;
+    }
+    config.size_a = a;
+    config.size_b = b;
+
+    return 0;
+}
+
+int setup_queues(void)
+{
+    zz_event_wait_strategy_t strategy = {
+        config.mode->wait_mode, ZZ_EVENT_WAIT_DEFAULT_SPIN, ZZ_EVENT_WAIT_DEFAULT_YIELD};
+
+    for (uint32_t i = 0; i < config.n_queues; i++)
+    {
+        int32_t queue_id = (int32_t)i + 1;
+        atomic_init(&queue_counters[i].posted, 0);
+        atomic_init(&queue_counters[i].processed, 0);
+        if (zz_event_create_queue(queue_id) || zz_event_set_wait_strategy(queue_id, &strategy))
+        {
+            return 1;
+        }
+
+        for (uint32_t event_type = 1; event_type <= config.n_event_types; event_type++)
+        {
+            int err = config.batch > 1
+                          ? zz_event_register_event_batch_callback(queue_id, event_type, &handle_batch, &queue_counters[i])
+                          : zz_event_register_event_type_ctx_callback(queue_id, event_type, &handle_event, &queue_counters[i]);
+            if (err)
+            {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void *run_producer(void *arg)
+{
+    producer_t *producer = arg;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (producer->index + 1);
+    char *payloads = malloc((size_t)config.size_b * config.batch);
+    if (payloads == NULL)
+    {
+        fprintf(stderr, "Unable to allocate the payloads of producer %u.\n", producer->index);
+        return NULL;
+    }
+
+    // Start on different queues and types, so the producers do not move in step
+    uint32_t queue_index = producer->index % config.n_queues;
+    uint32_t event_type = producer->index % config.n_event_types;
+    uint64_t interval_ns = config.rate > 0 ? (uint64_t)(1e9 * config.batch / config.rate) : 0;
+    uint64_t next_ns = getMonotonicNs();
+    while (!atomic_load_explicit(&stop_producers, memory_order_relaxed))
+    {
+        if (interval_ns)
+        {
+            next_ns += interval_ns;
+            pace_until_ns(next_ns);
+        }
+
+        queue_counters_t *counters = &queue_counters[queue_index];
+        int32_t queue_id = (int32_t)queue_index + 1;
+        queue_index = (queue_index + 1) % config.n_queues;
+        event_type = event_type % config.n_event_types + 1;
+
+        if (config.max_pending)
+        {
+            int64_t pending = (int64_t)(atomic_load_explicit(&counters->posted, memory_order_relaxed) -
+                                        atomic_load_explicit(&counters->processed, memory_order_relaxed));
+            if (pending + config.batch > config.max_pending)
+            {
+                // Only a paced producer has events that are due and lost,
+                // an unlimited one waits for the consumers instead
+                if (interval_ns)
+                {
+                    producer->dropped += config.batch;
+                }
+                else
+                {
+                    sched_yield();
+                }
+                continue;
+            }
+        }
+
+        uint32_t data_size = draw_payload_size(&rng);
+        uint64_t posted_ns = getMonotonicNs();
+        for (uint32_t i = 0; i < config.batch; i++)
+        {
+            memcpy(payloads + (size_t)i * data_size, &posted_ns, sizeof(posted_ns));
+        }
+
+        int err = config.batch > 1
+                      ? zz_event_create_events_in_queue(queue_id, event_type, ZZ_EVENT_DATA_TYPE_STRUCT,
+                                                        payloads, data_size, config.batch)
+                      : zz_event_create_event_in_queue(queue_id, event_type, ZZ_EVENT_DATA_TYPE_STRUCT,
+                                                       payloads, data_size, NULL);
+        if (err)
+        {
+            producer->failed += config.batch;
+            continue;
+        }
+        producer->posted += config.batch;
+        atomic_fetch_add_explicit(&counters->posted, config.batch, memory_order_relaxed);
+    }
+
+    free(payloads);
+
+    return NULL;
+}
+
+void *run_consumer(void *arg)
+{
+    consumer_t *consumer = arg;
+    while (!atomic_load_explicit(&stop_consumers, memory_order_relaxed))
+    {
+        if (consumer->n_queues == 1)
+        {
+            zz_event_wait_events(consumer->queue_ids[0], CONSUMER_WAIT_US, NULL);
+            zz_event_process_events(consumer->queue_ids[0], NULL);
+        }
+        else
+        {
+            // Only one queue can be waited for, the others are checked at
+            // least every CONSUMER_WAIT_US
+            int32_t n_events = 0;
+            zz_event_process_queues(consumer->queue_ids, consumer->n_queues, CONSUMER_EVENTS_PER_TURN, 0, &n_events, NULL);
+            if (n_events == 0)
+            {
+                zz_event_wait_events(consumer->queue_ids[0], CONSUMER_WAIT_US, NULL);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t draw_payload_size(uint64_t *rng)
+{
+    switch (config.size_distribution)
+    {
+    case SIZE_UNIFORM:
+        return config.size_a + (uint32_t)(next_random(rng) % (config.size_b - config.size_a + 1));
+    case SIZE_EXP:
+    {
+        // Inverse transform of a uniform draw in (0, 1)
+        double uniform = ((double)(next_random(rng) >> 11) + 0.5) / 9007199254740992.0;
+        double size = -log(uniform) * config.size_a;
+        if (size < MIN_PAYLOAD_SIZE)
+        {
+            return MIN_PAYLOAD_SIZE;
+        }
+        return size > config.size_b ? config.size_b : (uint32_t)size;
+    }
+    case SIZE_FIXED:
+    default:
+        return config.size_a;
+    }
+}
+
+uint64_t next_random(uint64_t *state)
+{
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+void pace_until_ns(uint64_t deadline_ns)
+{
+    // Sleep for the long waits, spin for the short ones the scheduler would
+    // overshoot
+    uint64_t now_ns = getMonotonicNs();
+    if (deadline_ns > now_ns + 100000)
+    {
+        struct timespec ts = {(time_t)(deadline_ns / 1000000000ULL), (long)(deadline_ns % 1000000000ULL)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        {
+        }
+    }
+    while (getMonotonicNs() < deadline_ns)
+    {
+    }
+}
+
+void handle_event(zz_event_list_t *event, void *ctx)
+{
+    queue_counters_t *counters = ctx;
+    uint64_t posted_ns = 0;
+    memcpy(&posted_ns, zz_event_data(event), sizeof(posted_ns));
+    record_latency(getMonotonicNs() - posted_ns);
+    atomic_fetch_add_explicit(&counters->processed, 1, memory_order_relaxed);
+}
+
+void handle_batch(const zz_event_batch_t *batch, void *ctx)
+{
+    queue_counters_t *counters = ctx;
+    uint64_t now_ns = getMonotonicNs();
+    for (uint32_t i = 0; i < batch->n_events; i++)
+    {
+        uint64_t posted_ns = 0;
+        memcpy(&posted_ns, (const char *)batch->data + (size_t)i * batch->data_size, sizeof(posted_ns));
+        record_latency(now_ns - posted_ns);
+    }
+    atomic_fetch_add_explicit(&counters->processed, batch->n_events, memory_order_relaxed);
+}
+
+void record_latency(uint64_t latency_ns)
+{
+    latency_stats_t *stats = thread_stats;
+    if (stats == NULL)
+    {
+        // The runtime workers are not created here, so every consumer
+        // registers its stats on its first event
+        stats = calloc(1, sizeof(latency_stats_t));
+        if (stats == NULL)
+        {
+            return;
+        }
+        pthread_mutex_lock(&stats_mtx);
+        stats->next = all_stats;
+        all_stats = stats;
+        pthread_mutex_unlock(&stats_mtx);
+        thread_stats = stats;
+    }
+
+    stats->histogram[histogram_bucket(latency_ns)]++;
+    stats->count++;
+    if (latency_ns > stats->max_ns)
+    {
+        stats->max_ns = latency_ns;
+    }
+}
+
+uint32_t histogram_bucket(uint64_t value)
+{
+    // HISTOGRAM_SUB_BUCKETS linear buckets per power of two
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return (uint32_t)value;
+    }
+    uint32_t shift = (uint32_t)(63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (uint32_t)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+uint64_t histogram_bucket_max(uint32_t bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t mantissa = HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t get_posted(void)
+{
+    uint64_t posted = 0;
+    for (uint32_t i = 0; i < config.n_queues; i++)
+    {
+        posted += atomic_load_explicit(&queue_counters[i].posted, memory_order_relaxed);
+    }
+
+    return posted;
+}
+
+uint64_t get_processed(void)
+{
+    uint64_t processed = 0;
+    for (uint32_t i = 0; i < config.n_queues; i++)
+    {
+        processed += atomic_load_explicit(&queue_counters[i].processed, memory_order_relaxed);
+    }
+
+    return processed;
+}
+
+void print_latencies(void)
+{
+    static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+    static uint64_t histogram[HISTOGRAM_BUCKETS];
+    uint64_t count = 0;
+    uint64_t max_ns = 0;
+    for (latency_stats_t *stats = all_stats; stats; stats = stats->next)
+    {
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            histogram[i] += stats->histogram[i];
+        }
+        count += stats->count;
+        max_ns = stats->max_ns > max_ns ? stats->max_ns : max_ns;
+    }
+
+    if (count == 0)
+    {
+        printf("Latency:   no event processed\n");
+        return;
+    }
+
+    // From the post to the callback, as the upper bound of the bucket
+    printf("Latency:  ");
+    uint64_t seen = 0;
+    uint32_t bucket = 0;
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    {
+        uint64_t rank = (uint64_t)ceil(percentiles[i] / 100.0 * (double)count);
+        while (bucket < HISTOGRAM_BUCKETS && seen + histogram[bucket] < rank)
+        {
+            seen += histogram[bucket++];
+        }
+        uint64_t value_ns = histogram_bucket_max(bucket);
+        printf(" p%g %.1f us,", percentiles[i], (double)(value_ns < max_ns ? value_ns : max_ns) / 1000.0);
+    }
+    printf(" max %.1f us\n", (double)max_ns / 1000.0);
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <zz_event.h>
+#include <utils.h>
+
+/// Queue filled by the benchmark
+#define MEMBENCH_QUEUE 1
+/// Event type of the benchmark events
+#define MEMBENCH_EVENT 1
+
+static uint64_t n_dispatched = 0;
+
+// Private prototypes
+uint64_t get_resident_bytes(void);
+void count_event(zz_event_list_t *event);
+
+int main(int argc, char **argv)
+{
+    if (argc > 3)
+    {
+        fprintf(stderr, "Usage: %s [events] [payload bytes]\n", argv[0]);
+        fprintf(stderr, "  events:        pending events to keep in the queue (default 1000000).\n");
+        fprintf(stderr, "  payload bytes: size of the payload of every event (default 4).\n");
+        return EXIT_FAILURE;
+    }
+
+    long n_events = argc > 1 ? atol(argv[1]) : 1000000;
+    long payload_size = argc > 2 ? atol(argv[2]) : 4;
+    if (n_events < 1 || payload_size < 0)
+    {
+        fprintf(stderr, "Wrong number of events or payload size.\n");
+        return EXIT_FAILURE;
+    }
+
+    zz_event_init();
+    zz_event_set_verbose(false);
+    zz_event_create_queue(MEMBENCH_QUEUE);
+    zz_event_register_event_type_callback(MEMBENCH_QUEUE, MEMBENCH_EVENT, &count_event);
+
+    char *payload = calloc(1, (size_t)payload_size + 1);
+
+    // Measured after the queue is created, only the pending events count
+    uint64_t start_bytes = get_resident_bytes();
+    uint64_t start_ns = getMonotonicNs();
+    for (long i = 0; i < n_events; i++)
+    {
+        if (zz_event_create_event_in_queue(
+                MEMBENCH_QUEUE, MEMBENCH_EVENT, ZZ_EVENT_DATA_TYPE_UNDEFINED,
+                payload, (uint32_t)payload_size, NULL))
+        {
+            fprintf(stderr, "Unable to post event %ld.\n", i);
+            break;
+        }
+    }
+    uint64_t post_ns = getMonotonicNs() - start_ns;
+    uint64_t pending_bytes = get_resident_bytes() - start_bytes;
+
+    start_ns = getMonotonicNs();
+    zz_event_process_events(MEMBENCH_QUEUE, NULL);
+    uint64_t drain_ns = getMonotonicNs() - start_ns;
+
+    printf("Event header:    %zu bytes\n", sizeof(zz_event_list_t));
+    printf("Pending events:  %ld with %ld bytes of payload\n", n_events, payload_size);
+    printf("Resident memory: %.1f MiB, %.1f bytes per pending event\n",
+           (double)pending_bytes / (1024.0 * 1024.0), (double)pending_bytes / (double)n_events);
+    printf("Posted in %.1f ms (%.1f ns per event), drained in %.1f ms (%.1f ns per event)\n",
+           (double)post_ns / 1e6, (double)post_ns / (double)n_events,
+           (double)drain_ns / 1e6, (double)drain_ns / (double)n_events);
+
+    if (n_dispatched != (uint64_t)n_events)
+    {
+        fprintf(stderr, "Only %" PRIu64 " events dispatched.\n", n_dispatched);
+    }
+
+    free(payload);
+    zz_event_delete_queue(MEMBENCH_QUEUE);
+    zz_event_deinit();
+
+    return n_dispatched == (uint64_t)n_events ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Private implementation
+uint64_t get_resident_bytes(void)
+{
+    // Second field of statm: resident pages
+    unsigned long size_pages = 0;
+    unsigned long resident_pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (fscanf(statm, "%lu %lu", &size_pages, &resident_pages) != 2)
+        {
+            resident_pages = 0;
+        }
+        fclose(statm);
+    }
+
+    return (uint64_t)resident_pages * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+void count_event(zz_event_list_t *event)
+{
+    (void)event;
+    n_dispatched++;
+}
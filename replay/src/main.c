@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <dlfcn.h>
+
+#include <zz_event.h>
+#include <zz_event_buffer.h>
+#include <zz_event_capture.h>
+#include <zz_event_runtime.h>
+#include <utils.h>
+
+/// Function exported by a handlers library, called for every queue of the
+/// trace to register the callbacks of the application
+#define REPLAY_REGISTER_SYMBOL "zz_event_replay_register_handlers"
+
+typedef int(replay_register_handlers)(int32_t queue_id);
+
+static int32_t queue_ids[ZZ_EVENT_EVENT_MAX_EVENT_QUEUE];
+
+/// Digest of the events dispatched by every queue, in dispatch order
+static uint64_t queue_digests[ZZ_EVENT_EVENT_MAX_EVENT_QUEUE];
+
+static uint32_t n_queues = 0;
+
+void digest_event(
+    zz_event_list_t *event,
+    void *ctx);
+
+uint64_t digest_bytes(
+    uint64_t digest,
+    const void *data,
+    uint64_t size);
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <trace file> [speed] [workers] [handlers]\n", argv[0]);
+        fprintf(stderr, "  speed:    1.0 replays with the original timing (default),\n");
+        fprintf(stderr, "            N > 1 replays N times faster, 0 replays without delays.\n");
+        fprintf(stderr, "  workers:  threads processing the queues (default 1).\n");
+        fprintf(stderr, "  handlers: shared library exporting\n");
+        fprintf(stderr, "            int %s(int32_t queue_id),\n", REPLAY_REGISTER_SYMBOL);
+        fprintf(stderr, "            called for every queue to register its callbacks.\n");
+        fprintf(stderr, "            Without it the events are only digested.\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *path = argv[1];
+    double speed = argc > 2 ? atof(argv[2]) : 1.0;
+    int n_workers = argc > 3 ? atoi(argv[3]) : 1;
+    const char *handlers_path = argc > 4 ? argv[4] : NULL;
+
+    uint64_t n_trace_events = 0;
+    if (zz_event_capture_scan(path, queue_ids, ZZ_EVENT_EVENT_MAX_EVENT_QUEUE, &n_queues, &n_trace_events))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (n_queues > ZZ_EVENT_EVENT_MAX_EVENT_QUEUE)
+    {
+        fprintf(stderr, "The trace uses %u queues, only %d are supported.\n", n_queues, ZZ_EVENT_EVENT_MAX_EVENT_QUEUE);
+        return EXIT_FAILURE;
+    }
+
+    zz_event_init();
+    zz_event_set_verbose(false);
+
+    replay_register_handlers *register_handlers = NULL;
+    void *handlers = NULL;
+    if (handlers_path)
+    {
+        handlers = dlopen(handlers_path, RTLD_NOW);
+        // The cast goes through a pointer, ISO C does not convert void * to
+        // a function pointer
+        void *symbol = handlers ? dlsym(handlers, REPLAY_REGISTER_SYMBOL) : NULL;
+        memcpy(&register_handlers, &symbol, sizeof(symbol));
+        if (register_handlers == NULL)
+        {
+            fprintf(stderr, "Unable to load the handlers from <%s>: %s\n", handlers_path, dlerror());
+            zz_event_deinit();
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (uint32_t i = 0; i < n_queues; i++)
+    {
+        zz_event_create_queue(queue_ids[i]);
+        // Every event goes through the digest, after the callbacks of the
+        // application, so two replays of a trace can be compared
+        queue_digests[i] = 14695981039346656037ULL;
+        zz_event_register_event_mask_callback(queue_ids[i], 0, 0, &digest_event, &queue_digests[i]);
+        if (register_handlers && register_handlers(queue_ids[i]))
+        {
+            fprintf(stderr, "Unable to register the handlers of queue <%d>.\n", queue_ids[i]);
+        }
+    }
+
+    printf("Replaying %" PRIu64 " events in %u queues at speed %.2f with %d workers.\n",
+           n_trace_events, n_queues, speed, n_workers);
+
+    if (n_workers < 1 || zz_event_runtime_start((uint32_t)n_workers, 0))
+    {
+        fprintf(stderr, "Unable to start the runtime.\n");
+        zz_event_deinit();
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < n_queues; i++)
+    {
+        zz_event_runtime_attach(queue_ids[i]);
+    }
+
+    uint64_t n_replayed = 0;
+    uint64_t start_ns = getMonotonicNs();
+    int err = zz_event_replay(path, speed, &n_replayed);
+    uint64_t replay_ns = getMonotonicNs() - start_ns;
+
+    zz_event_runtime_wait_idle();
+    uint64_t total_ns = getMonotonicNs() - start_ns;
+
+    double replay_s = (double)replay_ns / 1e9;
+    double total_s = (double)total_ns / 1e9;
+    printf("Replayed:  %" PRIu64 " events in %.3f s (%.0f events/s)\n",
+           n_replayed, replay_s, replay_s > 0 ? (double)n_replayed / replay_s : 0.0);
+    uint64_t n_processed = 0;
+    zz_event_runtime_get_processed(&n_processed);
+    printf("Processed: %" PRIu64 " events in %.3f s (%.0f events/s)\n",
+           n_processed, total_s, total_s > 0 ? (double)n_processed / total_s : 0.0);
+
+    zz_event_runtime_stop();
+
+    // The queues are digested in the order of the trace, which does not
+    // depend on the scheduling of the workers
+    uint64_t digest = 14695981039346656037ULL;
+    for (uint32_t i = 0; i < n_queues; i++)
+    {
+        digest = digest_bytes(digest, &queue_digests[i], sizeof(queue_digests[i]));
+    }
+    printf("Digest:    %016" PRIx64 "\n", digest);
+
+    zz_event_deinit();
+    if (handlers)
+    {
+        dlclose(handlers);
+    }
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void digest_event(zz_event_list_t *event, void *ctx)
+{
+    // A queue runs on one worker at a time, its digest is not shared
+    uint64_t *digest = ctx;
+    *digest = digest_bytes(*digest, &event->event_type, sizeof(event->event_type));
+
+    zz_event_buffer_t *buffer = zz_event_buffer_from_event(event);
+    if (buffer)
+    {
+        *digest = digest_bytes(*digest, buffer->data, buffer->size);
+    }
+    else
+    {
+        *digest = digest_bytes(*digest, zz_event_data(event), event->data_size);
+    }
+}
+
+uint64_t digest_bytes(uint64_t digest, const void *data, uint64_t size)
+{
+    // FNV-1a
+    const unsigned char *bytes = data;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        digest = (digest ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return digest;
+}